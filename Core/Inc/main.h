@@ -85,8 +85,11 @@ void Error_Handler(void);
 #define TCK_GPIO_Port GPIOA
 #define SWO_Pin GPIO_PIN_3
 #define SWO_GPIO_Port GPIOB
+#define TRIG_IN_Pin GPIO_PIN_6
+#define TRIG_IN_GPIO_Port GPIOB
 
 /* USER CODE BEGIN Private defines */
+// TRIG_IN: external trigger input, falling edge, captured by TIM4 CH1 (Arduino header D10)
 
 /* USER CODE END Private defines */
 
@@ -8,7 +8,22 @@
 // User-configurable Parameters
 //================================================================================
 #define S10077_NUM_PIXELS           1024
-#define S10077_INTEGRATION_TIME_MS  10
+#define S10077_INTEGRATION_TIME_MS  10    // Default integration time (ST high), see S10077_SetIntegrationTime()
+#define S10077_PIXEL_CLOCK_MAX_HZ   1000000 // Sensor CLK limit, see S10077_SetPixelClock()
+#define S10077_MAX_SENSORS          3     // Most sensors S10077_System_Init() accepts
+#define S10077_PEAK_THRESHOLD       500   // Default peak detection threshold (raw ADC counts)
+#define S10077_EDGE_HYSTERESIS      50    // Default edge confirmation hysteresis (raw ADC counts)
+#define S10077_SATURATION_LEVEL     4095  // Pixels at or above this value count as saturated
+#define S10077_HIST_BINS            64    // Default histogram bin count (power of two, up to 256)
+#define S10077_HDR_KNEE             3800  // Long-exposure pixels at or above this are replaced by scaled short ones
+#define S10077_HDR_MAX_RATIO        8     // Keeps merged frames below 32768 (15 bits) for the Q15 stages
+#define S10077_RAM_POOL_BYTES       81920 // Tables of the configured sensors and loaded LUTs; the frame store gets the rest
+#define S10077_TX_QUEUE_BYTES       8192  // UART output queue (power of two, more than one RAW record)
+#define S10077_MAX_LUTS             2     // Number of ADCs that can hold a linearization table
+#define S10077_MAX_OVERSAMPLING     4     // Most conversions averaged per pixel
+#define S10077_WL_COEFFS            6     // Wavelength calibration polynomial terms (up to 5th order)
+#define S10077_WL_GRID_START_NM     400.0f // Default uniform wavelength grid shared by all sensors
+#define S10077_WL_GRID_END_NM       1000.0f
 
 //================================================================================
 // Sensor Configuration Structure
@@ -26,8 +41,71 @@ typedef struct {
 
     GPIO_TypeDef* 	   st_port;            // GPIO port for the ST signal (e.g., ST1_GPIO_Port)
     uint16_t           st_pin;             // GPIO pin for the ST signal (e.g., ST1_Pin)
+
+    const float*       wavelength_coeffs;  // Calibration wl(p) = c[0] + c[1]*p + ... + c[5]*p^5 in nm, or NULL
+    uint32_t           sample_phase_ns;    // Delay from the TRG edge to the ADC trigger (see S10077_CalibrateSamplePhase())
 } S10077_SensorConfig;
 
+//================================================================================
+// Output Modes
+//================================================================================
+/**
+ * @brief  Selects what S10077_PrintDataViaUART() transmits for a sensor.
+ */
+typedef enum {
+    S10077_OUTPUT_RAW = 0,  // Full frame: "BEGIN,SENSOR_[ID],SEQ_[seq],TS_[timestamp_us],{data...},END\r\n"
+    S10077_OUTPUT_PEAKS,    // Peak list: "PEAKS,SENSOR_[ID],{seq},{timestamp_us},{dropped},{count},{position,height,width}...,END\r\n"
+    S10077_OUTPUT_EDGES,    // Edge list: "EDGES,SENSOR_[ID],{seq},{timestamp_us},{dropped},{count},{+rising|-falling position}...,END\r\n"
+    S10077_OUTPUT_STATS,    // Summary: "STATS,SENSOR_[ID],{seq},{timestamp_us},{dropped},{sum},{min},{max},{argmax},{mean},{saturated},END\r\n"
+    S10077_OUTPUT_HISTOGRAM,// Histogram only: "HIST,SENSOR_[ID],{seq},{timestamp_us},{dropped},{bins},{counts...},END\r\n"
+    S10077_OUTPUT_CHANGE,   // Full frame with a "CHANGE_[metric]" header token, only when it differs from the last one sent
+} S10077_OutputMode;
+
+/**
+ * @brief  Difference measure used by S10077_OUTPUT_CHANGE.
+ */
+typedef enum {
+    S10077_CHANGE_SAD = 0,       // Sum of absolute pixel differences
+    S10077_CHANGE_MAX,           // Largest absolute pixel difference
+} S10077_ChangeMetric;
+
+/**
+ * @brief  What happens to a sensor's frames when the UART output queue is full (see S10077_SetBackpressure()).
+ */
+typedef enum {
+    S10077_BACKPRESSURE_BLOCK = 0,   // Wait for room (up to 1 s, then drop); acquisition slows down to the link rate
+    S10077_BACKPRESSURE_DROP_NEWEST, // Discard the new frame
+    S10077_BACKPRESSURE_DROP_OLDEST, // Discard the sensor's oldest frames that have not started sending
+    S10077_BACKPRESSURE_DECIMATE,    // While a frame of the sensor is queued, queue only one of every N frames
+} S10077_Backpressure;
+
+/**
+ * @brief  ADC resolution of the acquisitions (see S10077_SetResolution()).
+ */
+typedef enum {
+    S10077_RESOLUTION_12BIT = 0, // 15 ADC clocks per conversion with the shortest sampling time
+    S10077_RESOLUTION_10BIT,     // 13 ADC clocks
+    S10077_RESOLUTION_8BIT,      // 11 ADC clocks
+} S10077_Resolution;
+
+/**
+ * @brief  Storage format of the frames held in the RAM frame store.
+ */
+typedef enum {
+    S10077_STORE_16BIT = 0,      // 2 bytes per pixel, lossless
+    S10077_STORE_12BIT_PACKED,   // 3 bytes per 2 pixels, lossless for 12-bit data
+    S10077_STORE_8BIT,           // 1 byte per pixel, upper 8 of 12 bits
+} S10077_StoreFormat;
+
+/**
+ * @brief  Event that fired a pre-trigger capture (see S10077_ArmPreTrigger()).
+ */
+typedef enum {
+    S10077_TRIGGER_HOST = 0,     // S10077_Trigger() called by the application or a host command
+    S10077_TRIGGER_GPIO,         // S10077_Trigger() called from the trigger input interrupt
+    S10077_TRIGGER_LEVEL,        // A frame's maximum reached the level set by S10077_SetPreTriggerLevel()
+} S10077_TriggerSource;
+
 //================================================================================
 // Public Function Prototypes
 //================================================================================
@@ -47,6 +125,200 @@ void S10077_System_Init(const S10077_SensorConfig* configs, uint8_t num_sensors,
  */
 void S10077_StartAcquisition(uint8_t sensor_id);
 
+/**
+ * @brief  Prepares an acquisition that is started by the next external trigger edge or, while the frame clock
+ * runs, by its next tick instead of by firmware. The ADC chain is configured up front, so the interrupt only
+ * has to assert ST. The integration is ended by a compare interrupt of the trigger timer (see
+ * S10077_SetTriggerTimer()), or by S10077_IsDataReady() when no trigger timer is set; poll it as usual.
+ * RAW frames started by a trigger carry "TRIG_[event count],TRIGLAT_[ns]" header tokens (captured trigger edge,
+ * or trigger interrupt without a trigger timer, to ST assertion), frames started by the clock
+ * "TICK_[tick],MISSED_[missed ticks so far]". Non-blocking.
+ * @param  sensor_id: The index of the sensor to acquire from.
+ */
+void S10077_ArmAcquisition(uint8_t sensor_id);
+
+/**
+ * @brief  Withdraws an acquisition armed by S10077_ArmAcquisition() that has not been started yet.
+ */
+void S10077_CancelArmedAcquisition(void);
+
+/**
+ * @brief  Handles an external trigger edge; call from an EXTI trigger input interrupt when no trigger timer is
+ * set. Asserts ST of the armed sensor immediately. Edges arriving while nothing is armed, or while the frame
+ * clock runs, are counted as missed.
+ */
+void S10077_ExternalTriggerISR(void);
+
+/**
+ * @brief  Hands a timer to the driver for the trigger input and the integration end. CH1 must be configured
+ * as input capture on TRIG_IN and CH2 as output compare (timing), with the timer interrupt enabled in the NVIC.
+ * The driver sets it to 10 MHz: captured edges start armed acquisitions and fire the pre-trigger capture
+ * (like S10077_ExternalTriggerISR() and S10077_Trigger(), timed from the edge itself), and CH2 compares end
+ * the integration, so ST no longer depends on how often S10077_IsDataReady() is polled.
+ * @param  htim: 16- or 32-bit timer whose clock is a multiple of 10 MHz (e.g. &htim4).
+ * @retval false if the timer is unsuitable or an acquisition is in progress.
+ */
+bool S10077_SetTriggerTimer(TIM_HandleTypeDef* htim);
+
+/**
+ * @brief  Reads the external trigger counters since boot.
+ * @param  triggers: Output number of trigger edges seen.
+ * @param  missed: Output number of edges that arrived while no acquisition was armed.
+ */
+void S10077_GetExternalTriggerCounts(uint32_t* triggers, uint32_t* missed);
+
+/**
+ * @brief  Starts the fixed-period frame clock. Every tick starts the acquisition armed with
+ * S10077_ArmAcquisition(), so the frame period does not depend on processing or UART time.
+ * A tick that finds nothing armed (pipeline still busy) is counted as missed.
+ * @param  htim: Timer counting at 1 MHz with its update interrupt enabled in the NVIC (e.g. &htim5).
+ * @param  period_us: Frame period in microseconds (at least 2, and longer than the integration time).
+ * @retval false if the period is invalid or the timer could not be started.
+ */
+bool S10077_StartFrameClock(TIM_HandleTypeDef* htim, uint32_t period_us);
+
+/**
+ * @brief  Stops the frame clock. Armed acquisitions then wait for an external trigger again.
+ */
+void S10077_StopFrameClock(void);
+
+/**
+ * @brief  Reads the frame clock counters since the last S10077_StartFrameClock().
+ * @param  ticks: Output number of ticks.
+ * @param  missed: Output number of ticks that found no acquisition armed.
+ */
+void S10077_GetFrameClockCounts(uint32_t* ticks, uint32_t* missed);
+
+/**
+ * @brief  Changes the pixel clock (CLK) shared by all sensors. The CLK timer period and duty cycle are recomputed,
+ * and the ADC prescaler and sampling time are chosen so that each conversion fits into one pixel period: the
+ * longest sampling time that fits is used, so slower clocks give quieter samples. Frame readout takes
+ * S10077_NUM_PIXELS clock periods.
+ * @param  clock_hz: Requested frequency. The timer divides its input clock by an integer, see S10077_GetPixelClock().
+ * @retval false if the frequency is above S10077_PIXEL_CLOCK_MAX_HZ, out of the timer's range, too fast for any
+ * ADC conversion, or an acquisition is in progress. The current clock is kept.
+ */
+bool S10077_SetPixelClock(uint32_t clock_hz);
+
+/**
+ * @brief  Returns the actual pixel clock in Hz.
+ */
+uint32_t S10077_GetPixelClock(void);
+
+/**
+ * @brief  Switches to dual-ADC interleaved sampling, or back to a single ADC. ADC1 converts on every other TRG edge
+ * and ADC2 one pixel period later, so each ADC has two pixel periods per conversion: the sampling time can be
+ * longer at the same pixel clock, and faster clocks become usable. The pair is read as one DMA word.
+ * The second ADC must start exactly one pixel period after the first, 5 to 20 ADC clocks, which ties the pixel
+ * clock to the ADC clock (e.g. 1 MHz, 750 kHz or 562.5 kHz); set the pixel clock first.
+ * @param  hadc_slave: Handle of ADC2, or NULL to return to single-ADC sampling. All sensors must use ADC1.
+ * @retval false if the pixel clock has no matching interleaved timing, the ADCs do not fit, the mode is already
+ * selected, or an acquisition is in progress.
+ */
+bool S10077_SetInterleaved(ADC_HandleTypeDef* hadc_slave);
+
+/**
+ * @brief  Selects the ADC resolution of all sensors. The shorter conversion of 10 and 8 bits leaves a longer
+ * sampling time at the current pixel clock (which is re-selected) and permits a faster S10077_SetPixelClock().
+ * Frames are scaled to the 12-bit range for processing, so thresholds and levels keep their meaning. RAW frames
+ * carry a "RES_[bits]" header token and native ADC codes; 8-bit frames are sent as two hex digits per pixel and
+ * always kept in the frame store as S10077_STORE_8BIT.
+ * @param  resolution: ADC resolution.
+ * @retval false if an acquisition is in progress. The current resolution is kept.
+ */
+bool S10077_SetResolution(S10077_Resolution resolution);
+
+/**
+ * @brief  Sets how many conversions of each pixel are averaged into its value. Every TRG edge starts a scan of
+ * 'factor' ranks on the sensor's channel, so the frame time is unchanged; the samples are averaged block by block
+ * in the DMA interrupt. All conversions must fit into one pixel period, so the sampling time is re-selected and
+ * gets shorter: 2x needs the shortest sampling time at 500 kHz and 12 bits, a slower pixel clock or a lower
+ * resolution leaves room for more. RAW frames carry an "OS_[factor]" header token.
+ * @param  factor: Conversions per pixel, 1 (off) to S10077_MAX_OVERSAMPLING.
+ * @retval false if the conversions do not fit at the current pixel clock and resolution, interleaved sampling
+ * is active, or an acquisition is in progress. The current factor is kept.
+ */
+bool S10077_SetOversampling(uint8_t factor);
+
+/**
+ * @brief  Sets the delay from a sensor's TRG edge to its ADC trigger, so the sampling window falls where the video
+ * output has settled. The trigger timer runs one pulse from each TRG edge and triggers the ADC on its channel 2
+ * compare.
+ * The initial value comes from the sensor configuration.
+ * @param  sensor_id: Sensor to configure.
+ * @param  phase_ns: Delay in ns; 0 triggers on the TRG edge itself. Applied from the next acquisition.
+ * @retval false if the sampling would extend past the pixel period at the current pixel clock and ADC timing,
+ * or a delay is requested while interleaved sampling is active (which requires 0 on all sensors).
+ */
+bool S10077_SetSamplePhase(uint8_t sensor_id, uint32_t phase_ns);
+
+/**
+ * @brief  Returns a sensor's TRG-to-ADC delay in ns.
+ */
+uint32_t S10077_GetSamplePhase(uint8_t sensor_id);
+
+/**
+ * @brief  Sweeps the sample phase of a sensor across the pixel period against a stable scene and keeps the phase
+ * with the best frame SNR (mean signal over RMS temporal noise). Blocks while acquiring steps * frames_per_step
+ * frames, which are not processed or sent. Each step is reported as
+ * "PHASE_SCAN,SENSOR_[ID],{phase_ns},{mean},{variance},END\r\n" (pixel averages), the result as
+ * "PHASE,SENSOR_[ID],{phase_ns},END\r\n"; copy it into the sensor configuration to keep it across resets.
+ * @param  sensor_id: Sensor to calibrate.
+ * @param  steps: Number of phases from 0 to the longest delay that fits (at least 2).
+ * @param  frames_per_step: Frames per phase for the noise estimate (at least 2).
+ * The sensor's sequence numbers are not advanced by these frames.
+ * @retval false if the sensor is not configured, the parameters are out of range, interleaved sampling or HDR
+ * bracketing is active, a noise accumulation or an acquisition is in progress, the frame clock runs, or the
+ * frame store whose RAM the moment sums borrow is in use.
+ */
+bool S10077_CalibrateSamplePhase(uint8_t sensor_id, uint8_t steps, uint16_t frames_per_step);
+
+/**
+ * @brief  Sets the integration time (ST high period) of a sensor. Timed with the DWT cycle counter.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  integration_us: Integration time in microseconds.
+ */
+void S10077_SetIntegrationTime(uint8_t sensor_id, uint32_t integration_us);
+
+/**
+ * @brief  Sets the target frame period and priority of a sensor for S10077_ScheduleNext().
+ * The first frame is released immediately.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  period_us: Target frame period in microseconds, or 0 to take the sensor out of the schedule.
+ * @param  priority: Breaks ties between frames with the same deadline; higher wins.
+ */
+void S10077_SetFramePeriod(uint8_t sensor_id, uint32_t period_us, uint8_t priority);
+
+/**
+ * @brief  Picks the sensor to acquire next, earliest deadline first. A sensor's frame is released once per
+ * period and is due by the next release. If a whole period passes without the frame being started, that
+ * period is skipped (counted, not made up for). Call when the acquisition chain is idle, then start the
+ * acquisition of the returned sensor.
+ * @retval Sensor index, or -1 if no scheduled frame is released yet.
+ */
+int8_t S10077_ScheduleNext(void);
+
+/**
+ * @brief  Sends one "SCHED,SENSOR_[ID],{period_us},{frames},{achieved_hz},{mean_lateness_us},{max_lateness_us},
+ * {skipped},END\r\n" line per scheduled sensor, covering the time since the previous report, and restarts
+ * the statistics. Lateness is the delay from a frame's release until S10077_ScheduleNext() picked it.
+ */
+void S10077_SendScheduleReport(void);
+
+/**
+ * @brief  Enables HDR exposure bracketing on a sensor. Acquisitions alternate between the short and the
+ * long integration time; the short frame is kept on the MCU and merged with the following long frame:
+ * long-exposure pixels are used unless they reach S10077_HDR_KNEE, otherwise the short pixel scaled by
+ * long_us / short_us. Only the merged frame (in long-exposure counts, up to 15 bits) is output, and RAW
+ * frames carry the ratio as an "HDR_[ratio]" header token. A long frame without a valid short partner is
+ * output unmerged, without the token. STATS count a merged pixel as saturated only if its short pixel was.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  short_us: Short integration time in microseconds, or 0 to disable HDR.
+ * @param  long_us: Long integration time; long_us / short_us must not exceed S10077_HDR_MAX_RATIO.
+ * @retval false if the exposure ratio is out of range.
+ */
+bool S10077_SetHDR(uint8_t sensor_id, uint32_t short_us, uint32_t long_us);
+
 /**
  * @brief  Checks if the data acquisition is complete.
  * @retval true if data is ready, false otherwise.
@@ -54,9 +326,276 @@ void S10077_StartAcquisition(uint8_t sensor_id);
 bool S10077_IsDataReady(void);
 
 /**
- * @brief  Transmits the acquired data of the last-read sensor over UART.
- * Format: "BEGIN,SENSOR_[ID],{data...},END\r\n"
+ * @brief  Transmits the acquired data of the last-read sensor over UART,
+ * encoded according to the sensor's output mode (see S10077_OutputMode).
+ * RAW frames start with "BEGIN,SENSOR_[ID],SEQ_[seq],TS_[timestamp_us],", followed by optional header tokens.
+ * When wavelength resampling is enabled, the RAW header carries the grid as
+ * "...,WLSTART_[nm],WLEND_[nm],{data...},END\r\n" (S10077_NUM_PIXELS uniform samples).
+ * Frames of a sensor in line-scan mode or armed for pre-trigger capture go to the frame store instead
+ * (see S10077_SetLineScan() and S10077_ArmPreTrigger()).
  */
 void S10077_PrintDataViaUART(void);
 
+/**
+ * @brief  Captures a burst of frames from one sensor back to back, at the sensor's maximum line rate,
+ * into the RAM frame store. Nothing is transmitted during the burst. Blocks until done.
+ * Frames are stored unprocessed; all processing stages run when they are sent.
+ * @param  sensor_id: The index of the sensor to acquire from.
+ * @param  num_frames: Number of frames to capture; limited by the store capacity for the format.
+ * @param  format: Storage format. Packed 12-bit and 8-bit hold 1.33x and 2x as many frames.
+ * @retval Number of frames actually captured (0 if an acquisition or a noise characterization is in progress).
+ */
+uint16_t S10077_CaptureBurst(uint8_t sensor_id, uint16_t num_frames, S10077_StoreFormat format);
+
+/**
+ * @brief  Sends every frame in the frame store, oldest first, through the normal output path with its
+ * original sequence number and timestamp. Blocks until the store is empty.
+ * Must not be called while an acquisition is in progress.
+ * @retval Number of frames sent.
+ */
+uint16_t S10077_SendStoredFrames(void);
+
+/**
+ * @brief  Arms continuous pre-trigger capture on a sensor. Its frames keep being acquired at the normal rate
+ * but go into the frame store, which always holds the last pre_frames of them. When a trigger fires, the
+ * next post_frames frames (starting with the one completing at the trigger) are added and the store freezes.
+ * The window is then sent as "TRIGGER,SENSOR_[ID],{source},{timestamp_us},{pre},{post},END\r\n" followed by
+ * the stored frames with their original sequence numbers and timestamps, one per call of
+ * S10077_PrintDataViaUART(), while live frames of the sensor are discarded. Capture then re-arms itself.
+ * Shares the frame store with S10077_CaptureBurst() and S10077_SetLineScan(), which disarm it.
+ * @param  sensor_id: The index of the sensor to monitor.
+ * @param  pre_frames: Frames kept from before the trigger (M).
+ * @param  post_frames: Frames captured from the trigger on (P, at least 1).
+ * @param  format: Storage format; pre_frames + post_frames must fit the store in this format.
+ * @retval false if the sensor is invalid, the window does not fit or a noise characterization is in progress.
+ */
+bool S10077_ArmPreTrigger(uint8_t sensor_id, uint16_t pre_frames, uint16_t post_frames, S10077_StoreFormat format);
+
+/**
+ * @brief  Stops pre-trigger capture and discards the stored window; the sensor returns to its normal output.
+ */
+void S10077_DisarmPreTrigger(void);
+
+/**
+ * @brief  Fires the pre-trigger capture when a frame's maximum pixel value reaches a level.
+ * The test runs on the unprocessed frame.
+ * @param  level: Trigger level in raw ADC counts, or 0 to disable the level trigger.
+ */
+void S10077_SetPreTriggerLevel(uint16_t level);
+
+/**
+ * @brief  Fires the pre-trigger capture. Safe to call from an interrupt handler; the time of the call is
+ * reported in the TRIGGER record. Ignored unless capture is armed and waiting for a trigger.
+ * @param  source: What caused the trigger.
+ */
+void S10077_Trigger(S10077_TriggerSource source);
+
+/**
+ * @brief  Starts line-scan mode on a sensor: its processed frames are collected as the lines of a 2D tile in the
+ * frame store instead of being sent, and every complete tile of L lines is sent as
+ * "TILE_BEGIN,SENSOR_[ID],{tile},{lines},{pixels},{RAW|MED},END\r\n", one
+ * "TILE_LINE,{line},{seq},{timestamp_us},{values...},END\r\n" per line and "TILE_END,SENSOR_[ID],{tile},END\r\n".
+ * The lines go out one per S10077_PrintDataViaUART() call under the sensor's backpressure policy, while the
+ * next tile is collected behind them; a line dropped by the policy is missing from its tile, and a line that
+ * finds the store full is not collected. Both count as dropped frames of the sensor.
+ * With compression the values are MED prediction residuals (see S10077_DSP_PredictMED()), which are mostly
+ * small because neighbouring lines of a moving web are strongly correlated.
+ * Uses the frame store, so it stops pre-trigger capture and is stopped by S10077_ArmPreTrigger() and
+ * S10077_CaptureBurst().
+ * @param  sensor_id: The index of the line-scan sensor.
+ * @param  lines: Lines per tile (L); must fit the store in the given format.
+ * @param  format: Storage format. Use S10077_STORE_16BIT for HDR frames, which exceed 12 bits.
+ * @param  compress: true to send prediction residuals instead of pixel values.
+ * @retval false if the sensor is invalid, the tile does not fit or a noise characterization is in progress.
+ */
+bool S10077_SetLineScan(uint8_t sensor_id, uint16_t lines, S10077_StoreFormat format, bool compress);
+
+/**
+ * @brief  Stops line-scan mode and discards the incomplete tile; the sensor returns to its normal output.
+ */
+void S10077_StopLineScan(void);
+
+/**
+ * @brief  Selects how a sensor's frames are treated when they are produced faster than the UART sends them.
+ * Records are queued and sent from the transmit interrupt, so acquisition continues while the link is busy.
+ * The sensor's running count of discarded frames is reported with every frame: as a "DROP_[count]" RAW header
+ * token (with any policy other than S10077_BACKPRESSURE_BLOCK, and under BLOCK once a timed-out wait dropped a
+ * frame) and as the {dropped} field of the summary records. The difference between two received records is
+ * the number of frames discarded between them. Stored frames are never dropped.
+ * @param  sensor_id: Index of the sensor (0-based).
+ * @param  policy: Backpressure policy.
+ * @param  decimation: For S10077_BACKPRESSURE_DECIMATE, keep one of this many frames (0 or 1 = keep all that fit).
+ */
+void S10077_SetBackpressure(uint8_t sensor_id, S10077_Backpressure policy, uint8_t decimation);
+
+/**
+ * @brief  Returns the number of frames of a sensor discarded by its backpressure policy.
+ * @param  sensor_id: Index of the sensor (0-based).
+ */
+uint32_t S10077_GetDroppedFrames(uint8_t sensor_id);
+
+/**
+ * @brief  Selects pull mode. Acquisition and processing continue as usual, but frames are no longer sent by
+ * S10077_PrintDataViaUART(); each sensor's most recent processed frame is kept on the MCU instead and sent
+ * when the host asks for it (see S10077_ProcessHostCommands()).
+ * @param  enable: true for pull mode, false to stream every frame.
+ */
+void S10077_SetPullMode(bool enable);
+
+/**
+ * @brief  Executes a pending host command, received on the UART in the background. Call it while waiting
+ * for acquisitions, including armed ones. Commands are text lines ending in CR or LF:
+ *   "GET [n]"  - sends sensor n's most recent processed frame (in pull mode and when streaming) as
+ *                "BEGIN,SENSOR_[ID],SEQ_[seq],TS_[timestamp_us],AGE_[us],{data...},END\r\n", where AGE is
+ *                the time since its end of integration, or "NODATA,SENSOR_[ID],END\r\n" if there is none.
+ *   "TRIGGER"  - fires the pre-trigger capture (S10077_Trigger() with S10077_TRIGGER_HOST).
+ * Deferred only while an armed acquisition integrates without a trigger timer, whose end is polled.
+ */
+void S10077_ProcessHostCommands(void);
+
+/**
+ * @brief  Selects the output mode of a sensor. All sensors start in S10077_OUTPUT_RAW.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  mode: The new output mode.
+ */
+void S10077_SetOutputMode(uint8_t sensor_id, S10077_OutputMode mode);
+
+/**
+ * @brief  Sets the minimum raw value a local maximum must reach to be reported in S10077_OUTPUT_PEAKS.
+ * Peak positions and widths are sent in pixels with two decimals (e.g. "512.37").
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  threshold: Detection threshold in raw ADC counts.
+ */
+void S10077_SetPeakThreshold(uint8_t sensor_id, uint16_t threshold);
+
+/**
+ * @brief  Configures edge detection for S10077_OUTPUT_EDGES.
+ * Edge positions are sent in pixels with two decimals, prefixed '+' for rising and '-' for falling edges.
+ * The timestamp is the end of integration (ST falling edge) in microseconds since boot.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  level: Crossing level in raw ADC counts, or 0 to use the midpoint of each frame's min and max.
+ * @param  hysteresis: Counts the signal must pass beyond the level before an edge is accepted.
+ */
+void S10077_SetEdgeDetection(uint8_t sensor_id, uint16_t level, uint16_t hysteresis);
+
+/**
+ * @brief  Dual-rate output: in the summary modes (S10077_OUTPUT_STATS, _PEAKS, _EDGES and _HISTOGRAM) every
+ * frame produces its summary record, and the first and then every Nth one is followed by the full frame in
+ * RAW format. The count is of records sent, so frames consumed on the MCU (e.g. HDR short exposures) do not
+ * shift it. Every summary record starts with the frame's {seq},{timestamp_us},{dropped}, and the full frames carry
+ * the same values as SEQ_, TS_ and DROP_ tokens, so both line up on one timeline.
+ * Can be changed at any time; the count restarts with the next frame.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  interval: N, or 0 to never send the full frame.
+ */
+void S10077_SetFullFrameInterval(uint8_t sensor_id, uint16_t interval);
+
+/**
+ * @brief  Configures S10077_OUTPUT_CHANGE. Each processed frame is compared with the last frame sent for the
+ * sensor; it is sent (and becomes the new reference) only if the difference exceeds the threshold, or as a
+ * heartbeat when heartbeat_frames frames have passed since the last one sent. Otherwise nothing is sent.
+ * Changing the settings makes the next frame be sent.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  metric: Difference measure.
+ * @param  threshold: The frame is sent when the difference is greater than this (counts, or summed counts for SAD).
+ * @param  heartbeat_frames: Maximum number of frames between two frames sent, or 0 for no heartbeat.
+ */
+void S10077_SetChangeDetection(uint8_t sensor_id, S10077_ChangeMetric metric, uint32_t threshold, uint16_t heartbeat_frames);
+
+/**
+ * @brief  Restricts the change-detection comparison to a pixel range. Frames are still sent in full.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  first_pixel: First pixel of the range.
+ * @param  num_pixels: Number of pixels, or 0 to compare the whole frame.
+ */
+void S10077_SetChangeROI(uint8_t sensor_id, uint16_t first_pixel, uint16_t num_pixels);
+
+/**
+ * @brief  Configures the per-frame intensity histogram of a sensor. The histogram is computed right after
+ * linearization, i.e. before temporal filtering. When enabled, a HIST record follows the sensor's normal
+ * output for every frame; in S10077_OUTPUT_HISTOGRAM it is sent instead of pixel data.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  num_bins: Power of two from 2 to 256 spanning the 12-bit range, or 0 to send no
+ * histogram alongside other modes (S10077_OUTPUT_HISTOGRAM then uses S10077_HIST_BINS).
+ */
+void S10077_SetHistogram(uint8_t sensor_id, uint16_t num_bins);
+
+/**
+ * @brief  Loads (copies) a 4096-entry linearization table for an ADC. Every frame converted by this ADC
+ * is mapped through the table as the first processing stage, before any other stage or output mode.
+ * In interleaved mode the odd pixels, converted by ADC2, use ADC2's table.
+ * The first table of an ADC takes 8 KB of the RAM pool away from the frame store, which is emptied, so
+ * load tables before using the store.
+ * @param  hadc: The ADC the table belongs to.
+ * @param  table: 4096 corrected values indexed by raw ADC code, or NULL to remove the ADC's table.
+ * @retval true on success, false if all S10077_MAX_LUTS slots are in use by other ADCs, or if a new
+ * slot is needed while the frame store is in use.
+ */
+bool S10077_SetLinearizationLUT(ADC_HandleTypeDef* hadc, const uint16_t* table);
+
+/**
+ * @brief  Enables a per-pixel exponential moving average on a sensor's frames.
+ * The filter is applied in place to every completed frame before it is encoded, with
+ * alpha = 1 / time_constant_frames. Changing the setting restarts the filter from the next frame.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  time_constant_frames: Time constant in frames, or 0/1 to disable the filter.
+ */
+void S10077_SetTemporalFilter(uint8_t sensor_id, uint16_t time_constant_frames);
+
+/**
+ * @brief  Enables a Savitzky-Golay FIR stage on a sensor's frames (after the temporal filter).
+ * With derivative 0 the smoothed frame replaces the raw one for every output mode. With derivative 1 or 2,
+ * S10077_OUTPUT_RAW sends the signed derived spectrum as "DERIV,SENSOR_[ID],{order},{data...},END\r\n"
+ * while the other modes keep working on the undifferentiated frame.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  window: Kernel length (5, 7, 9 or 11), or 0 to disable the stage.
+ * @param  derivative: 0 for smoothing, 1 for the first and 2 for the second derivative.
+ * @retval false if the window or derivative order has no kernel; the sensor's stage is left unchanged.
+ */
+bool S10077_SetSavitzkyGolay(uint8_t sensor_id, uint8_t window, uint8_t derivative);
+
+/**
+ * @brief  Measures the CPU cycles of every Savitzky-Golay kernel on the current frame buffer
+ * and sends one "SG_BENCH,{window},{derivative},{cycles},END\r\n" line per kernel.
+ * Must not be called while an acquisition is in progress.
+ */
+void S10077_BenchmarkSavitzkyGolay(void);
+
+/**
+ * @brief  Sets the uniform wavelength grid used for resampling by all sensors and recomputes
+ * every calibrated sensor's interpolation table. The grid has S10077_NUM_PIXELS samples.
+ * @param  start_nm: Wavelength of the first sample.
+ * @param  end_nm: Wavelength of the last sample (must be greater than start_nm).
+ */
+void S10077_SetWavelengthGrid(float start_nm, float end_nm);
+
+/**
+ * @brief  Enables resampling of a sensor's frames onto the uniform wavelength grid (after the temporal filter).
+ * The interpolation tables are built at S10077_System_Init() for the default grid. Grid samples outside the
+ * sensor's range are 0.
+ * @param  sensor_id: The index of the sensor to configure.
+ * @param  enable: true to resample, false to send native pixels.
+ * @retval false if resampling is enabled on a sensor without calibration coefficients (no table).
+ */
+bool S10077_SetWavelengthResampling(uint8_t sensor_id, bool enable);
+
+/**
+ * @brief  Starts per-pixel noise characterization on a sensor.
+ * The next num_frames frames of this sensor are accumulated on the MCU instead of being transmitted.
+ * When done, the per-pixel mean and sample variance are sent once as
+ * "NOISE_MEAN,SENSOR_[ID],{frames},{mean...},END\r\n" and "NOISE_VAR,SENSOR_[ID],{frames},{variance...},END\r\n"
+ * (two decimals), and the sensor returns to its normal output mode.
+ * The moment sums borrow the frame store, so nothing starts while the store is in use (pre-trigger capture,
+ * line scan or burst frames not sent yet); check S10077_IsNoiseAccumulationActive().
+ * @param  sensor_id: The index of the sensor to characterize.
+ * @param  num_frames: Number of frames to accumulate (at least 2).
+ */
+void S10077_StartNoiseAccumulation(uint8_t sensor_id, uint16_t num_frames);
+
+/**
+ * @brief  Checks whether a noise accumulation is in progress.
+ * @retval true while frames are still being accumulated or the result has not been sent yet.
+ */
+bool S10077_IsNoiseAccumulationActive(void);
+
 #endif /* INC_S10077_DRIVER_H_ */
@@ -0,0 +1,188 @@
+#ifndef INC_S10077_DSP_H_
+#define INC_S10077_DSP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//================================================================================
+// Frame Processing Parameters
+//================================================================================
+#define S10077_DSP_MAX_PEAKS        16
+#define S10077_DSP_MAX_EDGES        16
+#define S10077_DSP_SG_MAX_WINDOW    11    // Savitzky-Golay windows: 5, 7, 9, 11
+#define S10077_DSP_SG_MAX_DERIV     2     // Derivative orders: 0 (smoothing), 1, 2
+#define S10077_DSP_POSITION_INVALID 0xFFFFFFFFu  // Resampling position outside the source frame
+#define S10077_DSP_LUT_SIZE         4096  // One entry per 12-bit ADC code
+#define S10077_DSP_MAX_HIST_BINS    256
+
+//================================================================================
+// Result Structures
+//================================================================================
+/**
+ * @brief  A single detected peak. Position and width are in Q8 fixed point
+ * (1/256 pixel), so 0x0180 means pixel 1.5.
+ */
+typedef struct {
+    uint32_t position_q8;  // Sub-pixel peak position (parabolic vertex)
+    uint32_t width_q8;     // Full width at half height above the detection threshold
+    uint16_t height;       // Raw ADC value at the local maximum
+} S10077_Peak;
+
+/**
+ * @brief  A single detected edge (threshold crossing). Position is in Q8 fixed point.
+ */
+typedef struct {
+    uint32_t position_q8;  // Sub-pixel position where the signal crosses the level
+    int8_t   polarity;     // +1 for a rising edge, -1 for a falling edge
+} S10077_Edge;
+
+/**
+ * @brief  Per-frame summary statistics.
+ */
+typedef struct {
+    uint32_t sum;        // Sum of all pixel values
+    uint32_t mean_q8;    // Mean pixel value in Q8 fixed point
+    uint16_t min;        // Smallest pixel value
+    uint16_t max;        // Largest pixel value
+    uint16_t argmax;     // Index of the first pixel holding the largest value
+    uint16_t saturated;  // Number of pixels at or above the saturation level
+} S10077_FrameStats;
+
+//================================================================================
+// Public Function Prototypes
+//================================================================================
+
+/**
+ * @brief  Finds local maxima above a threshold and refines them to sub-pixel precision.
+ * If more than max_peaks are found, the strongest ones are kept. The result is sorted by position.
+ * @param  frame: Pointer to the pixel data.
+ * @param  length: Number of pixels in the frame.
+ * @param  threshold: Minimum raw value for a pixel to be considered a peak.
+ * @param  peaks: Output array for the detected peaks.
+ * @param  max_peaks: Capacity of the peaks array.
+ * @retval Number of peaks written to the peaks array.
+ */
+uint8_t S10077_DSP_FindPeaks(const uint16_t* frame, uint16_t length, uint16_t threshold, S10077_Peak* peaks, uint8_t max_peaks);
+
+/**
+ * @brief  Locates rising and falling edges with sub-pixel precision.
+ * An edge is confirmed once the signal moves 'hysteresis' counts past the level, and its
+ * position is then interpolated linearly at the exact level crossing.
+ * @param  frame: Pointer to the pixel data.
+ * @param  length: Number of pixels in the frame.
+ * @param  level: Crossing level in raw counts. 0 selects the midpoint between the frame's min and max.
+ * @param  hysteresis: Counts the signal must move beyond the level to confirm an edge.
+ * @param  edges: Output array for the detected edges, in position order.
+ * @param  max_edges: Capacity of the edges array. Further edges are ignored.
+ * @retval Number of edges written to the edges array.
+ */
+uint8_t S10077_DSP_FindEdges(const uint16_t* frame, uint16_t length, uint16_t level, uint16_t hysteresis, S10077_Edge* edges, uint8_t max_edges);
+
+/**
+ * @brief  Computes sum, min, max, argmax, mean and saturated-pixel count of a frame.
+ * All accumulators are updated in one pass; on Cortex-M4 two pixels are processed per
+ * 32-bit load with the DSP SIMD instructions.
+ * @param  frame: Pointer to the pixel data. Must be 4-byte aligned.
+ * @param  length: Number of pixels in the frame.
+ * @param  saturation_level: Pixels at or above this value are counted as saturated.
+ * @param  stats: Output structure.
+ */
+void S10077_DSP_ComputeStats(const uint16_t* frame, uint16_t length, uint16_t saturation_level, S10077_FrameStats* stats);
+
+/**
+ * @brief  Compares two frames pixel by pixel: sum of absolute differences and largest absolute difference.
+ * On Cortex-M4 two pixels are processed per 32-bit load with the DSP SIMD instructions.
+ * @param  a: Pointer to the first frame's pixel data (values must be below 32768).
+ * @param  b: Pointer to the second frame's pixel data, with the same 4-byte alignment offset as a.
+ * @param  length: Number of pixels to compare.
+ * @param  sad: Output sum of absolute differences.
+ * @param  max_diff: Output largest absolute difference.
+ */
+void S10077_DSP_FrameDifference(const uint16_t* a, const uint16_t* b, uint16_t length, uint32_t* sad, uint16_t* max_diff);
+
+/**
+ * @brief  Adds a frame to per-pixel running sums of values and squared values.
+ * Mean and variance follow exactly from the sums and the frame count (see S10077_DSP_MomentsToQ8).
+ * @param  frame: Pointer to the pixel data.
+ * @param  length: Number of pixels in the frame.
+ * @param  sum: Per-pixel sum of values, updated in place.
+ * @param  sum_sq: Per-pixel sum of squared values, updated in place.
+ */
+void S10077_DSP_AccumulateMoments(const uint16_t* frame, uint16_t length, uint32_t* sum, uint64_t* sum_sq);
+
+/**
+ * @brief  Converts the running sums of one pixel into mean and sample variance in Q8 fixed point.
+ * @param  sum: Sum of values over the frames.
+ * @param  sum_sq: Sum of squared values over the frames.
+ * @param  frames: Number of accumulated frames (variance is 0 when fewer than 2).
+ * @param  mean_q8: Output mean.
+ * @param  variance_q8: Output sample variance, saturated to UINT32_MAX from 2^24 up.
+ */
+void S10077_DSP_MomentsToQ8(uint32_t sum, uint64_t sum_sq, uint32_t frames, uint32_t* mean_q8, uint32_t* variance_q8);
+
+/**
+ * @brief  Per-pixel exponential moving average, applied to the frame in place.
+ * state = state + alpha * (frame - state), then frame = round(state).
+ * @param  frame: Pointer to the pixel data. Overwritten with the filtered values.
+ * @param  length: Number of pixels in the frame.
+ * @param  state_q16: Per-pixel filter state in Q16 fixed point.
+ * @param  alpha_q16: Smoothing factor in Q16 (65536 = no smoothing).
+ * @param  prime: true to load the state from this frame instead of filtering (first frame after a reset).
+ */
+void S10077_DSP_TemporalFilter(uint16_t* frame, uint16_t length, uint32_t* state_q16, uint32_t alpha_q16, bool prime);
+
+/**
+ * @brief  Applies a quadratic Savitzky-Golay smoothing or derivative kernel in one pass.
+ * Coefficients are Q15; on Cortex-M4 the inner loop uses SMLAD (two 16-bit MACs per cycle).
+ * Pixels closer than window/2 to the ends use the nearest valid sample (edge replication).
+ * @param  frame: Pointer to the pixel data (values must be below 32768).
+ * @param  out: Output array of the same length. Derivatives are per pixel (counts/pixel, counts/pixel^2).
+ * @param  length: Number of pixels in the frame (at least window).
+ * @param  window: Kernel length: 5, 7, 9 or 11.
+ * @param  derivative: 0 for smoothing, 1 for the first and 2 for the second derivative.
+ * @retval false if the window/derivative combination is not supported.
+ */
+bool S10077_DSP_SavitzkyGolay(const uint16_t* frame, int16_t* out, uint16_t length, uint8_t window, uint8_t derivative);
+
+/**
+ * @brief  Resamples a frame by linear interpolation at precomputed fractional source positions.
+ * @param  in: Source pixel data.
+ * @param  in_length: Number of source pixels.
+ * @param  positions_q16: Source position of every output sample in Q16, or S10077_DSP_POSITION_INVALID.
+ * @param  out: Output array (must not alias 'in'). Samples with an invalid position are set to 0.
+ * @param  out_length: Number of output samples.
+ */
+void S10077_DSP_Resample(const uint16_t* in, uint16_t in_length, const uint32_t* positions_q16, uint16_t* out, uint16_t out_length);
+
+/**
+ * @brief  Replaces every pixel with its entry in a lookup table, in place.
+ * @param  frame: Pointer to the pixel data (12-bit codes).
+ * @param  length: Number of pixels in the frame.
+ * @param  lut: Table of S10077_DSP_LUT_SIZE entries.
+ */
+void S10077_DSP_ApplyLUT(uint16_t* frame, uint16_t length, const uint16_t* lut);
+
+/**
+ * @brief  Computes an intensity histogram with equal-width, power-of-two bins in one pass.
+ * Bin index is value >> bin_shift; values beyond the last bin are counted in the last bin.
+ * @param  frame: Pointer to the pixel data.
+ * @param  length: Number of pixels in the frame.
+ * @param  bin_shift: log2 of the bin width in counts (e.g. 6 for 64 bins over 12 bits).
+ * @param  bins: Output counts, cleared by this function.
+ * @param  num_bins: Number of bins.
+ */
+void S10077_DSP_Histogram(const uint16_t* frame, uint16_t length, uint8_t bin_shift, uint16_t* bins, uint16_t num_bins);
+
+/**
+ * @brief  Computes the prediction residuals of one image line with the median edge detector (LOCO-I/JPEG-LS).
+ * Each pixel is predicted from its left (a), upper (b) and upper-left (c) neighbours: min(a,b) if c >= max(a,b),
+ * max(a,b) if c <= min(a,b), else a + b - c. Missing neighbours count as 0, so the first line is predicted from
+ * the left and the first column from above. Decoding runs the same prediction on the reconstructed pixels.
+ * @param  line: Pixel data of the line (values must be below 32768).
+ * @param  prev: Pixel data of the line above, or NULL for the first line.
+ * @param  residual: Output line - prediction.
+ * @param  length: Number of pixels per line.
+ */
+void S10077_DSP_PredictMED(const uint16_t* line, const uint16_t* prev, int16_t* residual, uint16_t length);
+
+#endif /* INC_S10077_DSP_H_ */
@@ -0,0 +1,86 @@
+#ifndef INC_S10077_FRAMESTORE_H_
+#define INC_S10077_FRAMESTORE_H_
+
+#include "s10077_driver.h"
+
+//================================================================================
+// Frame Store Types
+//================================================================================
+/**
+ * @brief  Acquisition context saved with every stored frame, so it can be replayed later.
+ */
+typedef struct {
+    uint32_t seq;           // Per-sensor sequence number
+    uint32_t timestamp_us;  // End of integration
+    uint8_t  sensor_id;
+    uint8_t  exposure;      // Driver-defined exposure tag (e.g. HDR phase)
+} S10077_FrameInfo;
+
+//================================================================================
+// Public Function Prototypes
+//================================================================================
+
+/**
+ * @brief  Places the store in a RAM arena and empties it, keeping the storage format.
+ * @param  arena: Start of the arena, 8-byte aligned.
+ * @param  bytes: Size of the arena (at most S10077_RAM_POOL_BYTES).
+ */
+void S10077_FrameStore_Init(uint8_t* arena, uint32_t bytes);
+
+/**
+ * @brief  Empties the store and selects the storage format. Capacity follows from
+ * the arena size and the bytes per frame of the format.
+ * @param  format: Storage format for all subsequent frames.
+ */
+void S10077_FrameStore_Reset(S10077_StoreFormat format);
+
+/**
+ * @brief  Empties the store and lends its arena as scratch memory. The store holds no frames
+ * until the next S10077_FrameStore_Reset().
+ * @param  bytes: Scratch size needed.
+ * @retval Start of the arena, or NULL if it is smaller than bytes.
+ */
+uint8_t* S10077_FrameStore_Borrow(uint32_t bytes);
+
+/**
+ * @brief  Returns how many frames the store can hold in the current format.
+ */
+uint16_t S10077_FrameStore_Capacity(void);
+
+/**
+ * @brief  Returns how many frames are currently stored.
+ */
+uint16_t S10077_FrameStore_Count(void);
+
+/**
+ * @brief  Appends a frame (S10077_NUM_PIXELS pixels) as the newest entry.
+ * @param  frame: Pixel data to store.
+ * @param  info: Acquisition context to store with it.
+ * @param  overwrite: true to drop the oldest frame when full (ring buffer), false to refuse.
+ * @retval false if the store is full and overwrite is false.
+ */
+bool S10077_FrameStore_Push(const uint16_t* frame, const S10077_FrameInfo* info, bool overwrite);
+
+/**
+ * @brief  Removes the oldest frame and unpacks it to 16-bit pixels.
+ * @param  frame: Output buffer of S10077_NUM_PIXELS pixels.
+ * @param  info: Output acquisition context.
+ * @retval false if the store is empty.
+ */
+bool S10077_FrameStore_Pop(uint16_t* frame, S10077_FrameInfo* info);
+
+/**
+ * @brief  Unpacks the oldest frame to 16-bit pixels, leaving it in the store.
+ * @param  frame: Output buffer of S10077_NUM_PIXELS pixels.
+ * @param  info: Output acquisition context.
+ * @retval false if the store is empty.
+ */
+bool S10077_FrameStore_Peek(uint16_t* frame, S10077_FrameInfo* info);
+
+/**
+ * @brief  Removes the oldest frame without unpacking it.
+ * @retval false if the store is empty.
+ */
+bool S10077_FrameStore_DropOldest(void);
+
+#endif /* INC_S10077_FRAMESTORE_H_ */
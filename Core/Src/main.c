@@ -41,11 +41,14 @@
 
 /* Private variables ---------------------------------------------------------*/
 ADC_HandleTypeDef hadc1;
+ADC_HandleTypeDef hadc2;
 DMA_HandleTypeDef hdma_adc1;
 
 TIM_HandleTypeDef htim1;
 TIM_HandleTypeDef htim2;
 TIM_HandleTypeDef htim3;
+TIM_HandleTypeDef htim4;
+TIM_HandleTypeDef htim5;
 
 UART_HandleTypeDef huart2;
 
@@ -53,6 +56,17 @@ UART_HandleTypeDef huart2;
 
 // --- User Configuration ---
 #define SENSORS_IN_USE 2 // We are using only one sensor now.
+#define USE_EXTERNAL_TRIGGER 0 // 1: every TRIG_IN edge acquires the next sensor instead of free-running
+#define FRAME_PERIOD_US 0      // >0: the TIM5 frame clock paces the acquisitions at this period
+#define USE_SCHEDULER 0        // 1: acquire each sensor at its own rate (sensor_periods_us), earliest deadline first
+#define SCHEDULE_REPORT_MS 1000
+// 1: frames are kept on the MCU and sent on "GET n" from the host instead of streamed
+#define USE_PULL_MODE 0
+#define PIXEL_CLOCK_HZ 0       // >0: CLK frequency instead of the 500 kHz set up by CubeMX
+#define ADC_RESOLUTION S10077_RESOLUTION_12BIT // 10 or 8 bits convert faster and allow a higher PIXEL_CLOCK_HZ
+#define USE_INTERLEAVED_ADC 0  // 1: ADC1 and ADC2 alternate pixels (needs a matching PIXEL_CLOCK_HZ, e.g. 1000000)
+#define ADC_OVERSAMPLING 1     // Conversions averaged per pixel (2 to 4 need headroom from PIXEL_CLOCK_HZ or ADC_RESOLUTION)
+#define CALIBRATE_SAMPLE_PHASE 0 // 1: sweep the TRG-to-ADC delay of every sensor at startup (needs a stable scene)
 
 // Sensor Configuration Array
 const S10077_SensorConfig sensor_configs[SENSORS_IN_USE] = {
@@ -85,6 +99,10 @@ const S10077_SensorConfig sensor_configs[SENSORS_IN_USE] = {
 //	  },
 };
 
+// Target frame period (us) and priority of each sensor when USE_SCHEDULER is set
+const uint32_t sensor_periods_us[SENSORS_IN_USE] = { 10000, 200000 };
+const uint8_t sensor_priorities[SENSORS_IN_USE] = { 1, 0 };
+
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -92,10 +110,13 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_DMA_Init(void);
 static void MX_ADC1_Init(void);
+static void MX_ADC2_Init(void);
 static void MX_TIM1_Init(void);
 static void MX_TIM3_Init(void);
 static void MX_USART2_UART_Init(void);
 static void MX_TIM2_Init(void);
+static void MX_TIM5_Init(void);
+static void MX_TIM4_Init(void);
 /* USER CODE BEGIN PFP */
 /* USER CODE END PFP */
 
@@ -134,15 +155,57 @@ int main(void)
   MX_GPIO_Init();
   MX_DMA_Init();
   MX_ADC1_Init();
+  MX_ADC2_Init();
   MX_TIM1_Init();
   MX_TIM3_Init();
   MX_USART2_UART_Init();
   MX_TIM2_Init();
+  MX_TIM5_Init();
+  MX_TIM4_Init();
   /* USER CODE BEGIN 2 */
   // Initialize the S10077 driver system with all necessary handles and configurations.
   // (JP) S10077ドライバシステムを�?�必要なすべてのハンドルと設定で初期化します�???????
   S10077_System_Init(sensor_configs, SENSORS_IN_USE, &htim1, &huart2);
   HAL_UART_Transmit(&huart2, (uint8_t*)"Multi-Sensor System Ready.\n", 27, HAL_MAX_DELAY);
+  S10077_SetTriggerTimer(&htim4);
+#if FRAME_PERIOD_US
+  S10077_StartFrameClock(&htim5, FRAME_PERIOD_US);
+#endif
+#if USE_SCHEDULER
+  for (int i = 0; i < SENSORS_IN_USE; i++)
+  {
+    S10077_SetFramePeriod(i, sensor_periods_us[i], sensor_priorities[i]);
+  }
+  uint32_t last_report_ms = HAL_GetTick();
+#endif
+#if USE_PULL_MODE
+  S10077_SetPullMode(true);
+#endif
+  S10077_SetResolution(ADC_RESOLUTION);
+#if PIXEL_CLOCK_HZ
+  if (!S10077_SetPixelClock(PIXEL_CLOCK_HZ))
+  {
+    HAL_UART_Transmit(&huart2, (uint8_t*)"Pixel clock rejected.\n", 22, HAL_MAX_DELAY);
+  }
+#endif
+#if USE_INTERLEAVED_ADC
+  if (!S10077_SetInterleaved(&hadc2))
+  {
+    HAL_UART_Transmit(&huart2, (uint8_t*)"Interleaved ADC rejected.\n", 26, HAL_MAX_DELAY);
+  }
+#endif
+#if ADC_OVERSAMPLING > 1
+  if (!S10077_SetOversampling(ADC_OVERSAMPLING))
+  {
+    HAL_UART_Transmit(&huart2, (uint8_t*)"Oversampling rejected.\n", 23, HAL_MAX_DELAY);
+  }
+#endif
+#if CALIBRATE_SAMPLE_PHASE
+  for (uint8_t i = 0; i < SENSORS_IN_USE; i++)
+  {
+    S10077_CalibrateSamplePhase(i, 16, 8);
+  }
+#endif
 
   /* USER CODE END 2 */
 
@@ -154,13 +217,44 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+#if USE_EXTERNAL_TRIGGER || FRAME_PERIOD_US
+	for (int i = 0; i < SENSORS_IN_USE; i++)
+	{
+		S10077_ArmAcquisition(i);
+		while (!S10077_IsDataReady())
+		{
+			S10077_ProcessHostCommands();
+		}
+		S10077_PrintDataViaUART();
+	}
+#elif USE_SCHEDULER
+	int8_t next = S10077_ScheduleNext();
+	if (next >= 0)
+	{
+		S10077_StartAcquisition(next);
+		while (!S10077_IsDataReady())
+		{
+			S10077_ProcessHostCommands();
+		}
+		S10077_PrintDataViaUART();
+	}
+	if (HAL_GetTick() - last_report_ms >= SCHEDULE_REPORT_MS)
+	{
+		last_report_ms = HAL_GetTick();
+		S10077_SendScheduleReport();
+	}
+#else
 	for (int i = 0; i < SENSORS_IN_USE; i++)
 	{
 		S10077_StartAcquisition(i);
-		while (!S10077_IsDataReady()){}
+		while (!S10077_IsDataReady())
+		{
+			S10077_ProcessHostCommands();
+		}
 		S10077_PrintDataViaUART();
 		HAL_Delay(50);
 	}
+#endif
   }
   /* USER CODE END 3 */
 }
@@ -270,6 +364,58 @@ static void MX_ADC1_Init(void)
 
 }
 
+/**
+  * @brief ADC2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_ADC2_Init(void)
+{
+
+  /* USER CODE BEGIN ADC2_Init 0 */
+
+  /* USER CODE END ADC2_Init 0 */
+
+  ADC_ChannelConfTypeDef sConfig = {0};
+
+  /* USER CODE BEGIN ADC2_Init 1 */
+
+  /* USER CODE END ADC2_Init 1 */
+
+  /** Configure the global features of the ADC (Clock, Resolution, Data Alignment and number of conversion)
+  */
+  hadc2.Instance = ADC2;
+  hadc2.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
+  hadc2.Init.Resolution = ADC_RESOLUTION_12B;
+  hadc2.Init.ScanConvMode = DISABLE;
+  hadc2.Init.ContinuousConvMode = DISABLE;
+  hadc2.Init.DiscontinuousConvMode = DISABLE;
+  hadc2.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE;
+  hadc2.Init.ExternalTrigConv = ADC_SOFTWARE_START;
+  hadc2.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  hadc2.Init.NbrOfConversion = 1;
+  hadc2.Init.DMAContinuousRequests = DISABLE;
+  hadc2.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+  if (HAL_ADC_Init(&hadc2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /** Configure for the selected ADC regular channel its corresponding rank in the sequencer and its sample time.
+  */
+  sConfig.Channel = ADC_CHANNEL_0;
+  sConfig.Rank = 1;
+  sConfig.SamplingTime = ADC_SAMPLETIME_28CYCLES;
+  if (HAL_ADC_ConfigChannel(&hadc2, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN ADC2_Init 2 */
+
+  /* USER CODE END ADC2_Init 2 */
+
+}
+
 /**
   * @brief TIM1 Initialization Function
   * @param None
@@ -479,6 +625,122 @@ static void MX_TIM3_Init(void)
 
 }
 
+/**
+  * @brief TIM5 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM5_Init(void)
+{
+
+  /* USER CODE BEGIN TIM5_Init 0 */
+
+  /* USER CODE END TIM5_Init 0 */
+
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+
+  /* USER CODE BEGIN TIM5_Init 1 */
+
+  /* USER CODE END TIM5_Init 1 */
+  htim5.Instance = TIM5;
+  htim5.Init.Prescaler = 90-1;
+  htim5.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim5.Init.Period = 100000-1;
+  htim5.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim5.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim5) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim5, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim5, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM5_Init 2 */
+
+  /* USER CODE END TIM5_Init 2 */
+
+}
+
+/**
+  * @brief TIM4 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM4_Init(void)
+{
+
+  /* USER CODE BEGIN TIM4_Init 0 */
+
+  /* USER CODE END TIM4_Init 0 */
+
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+  TIM_IC_InitTypeDef sConfigIC = {0};
+  TIM_OC_InitTypeDef sConfigOC = {0};
+
+  /* USER CODE BEGIN TIM4_Init 1 */
+
+  /* USER CODE END TIM4_Init 1 */
+  htim4.Instance = TIM4;
+  htim4.Init.Prescaler = 9-1;
+  htim4.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim4.Init.Period = 65535;
+  htim4.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim4.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim4) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim4, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_TIM_IC_Init(&htim4) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_TIM_OC_Init(&htim4) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim4, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigIC.ICPolarity = TIM_INPUTCHANNELPOLARITY_FALLING;
+  sConfigIC.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  sConfigIC.ICPrescaler = TIM_ICPSC_DIV1;
+  sConfigIC.ICFilter = 0;
+  if (HAL_TIM_IC_ConfigChannel(&htim4, &sConfigIC, TIM_CHANNEL_1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sConfigOC.OCMode = TIM_OCMODE_TIMING;
+  sConfigOC.Pulse = 0;
+  sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+  sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+  if (HAL_TIM_OC_ConfigChannel(&htim4, &sConfigOC, TIM_CHANNEL_2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN TIM4_Init 2 */
+
+  /* USER CODE END TIM4_Init 2 */
+
+}
+
 /**
   * @brief USART2 Initialization Function
   * @param None
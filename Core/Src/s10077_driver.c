@@ -1,127 +1,2718 @@
 #include "s10077_driver.h"
+#include "s10077_dsp.h"
+#include "s10077_framestore.h"
 #include <stdio.h>
 #include <string.h>
 
+//================================================================================
+// Private Defines
+//================================================================================
+#define HOST_LINE_MAX   32      // Longest host command line, including the terminator
+#define TX_QUEUE_ENTRIES 32     // Frames and records the output queue can hold
+#define TX_CHUNK_BYTES  256     // Bytes per interrupt transfer; queue space is released chunk by chunk
+#define TX_CONTROL      0xFF    // Queue entry owner for records that are never dropped
+#define TX_BLOCK_TIMEOUT_MS 1000 // Longest wait for queue space; a full queue drains in ~0.7 s at 115200 baud
+#define ADC_CLOCK_MAX_HZ        36000000u   // fADC limit at VDDA >= 2.4 V
+#define ADC_TIMING_MARGIN_PCT   10          // Share of the pixel period kept free for trigger latency
+#define OS_BLOCK_PIXELS 64      // Pixels per half of the oversampling DMA buffer, averaged in the DMA interrupt
+#define TRIGGER_TIMER_HZ        10000000u   // Trigger timer tick: 100 ns resolution for TRIGLAT and the integration end
+#define TRIGGER_TIMER_MAX_STEP  0x8000u     // Longest compare step, well inside the 16-bit counter period
+#define SENSOR_TABLE_BYTES  (S10077_NUM_PIXELS * 14)    // Latest, HDR short and change reference frames, EMA, wavelength positions
+#define LUT_BYTES           (S10077_DSP_LUT_SIZE * 2)
+#define NOISE_SUMS_BYTES    (S10077_NUM_PIXELS * 12)    // 64-bit squares and 32-bit sums, borrowed from the frame store
+
+#if S10077_MAX_SENSORS * SENSOR_TABLE_BYTES + S10077_MAX_LUTS * LUT_BYTES + NOISE_SUMS_BYTES > S10077_RAM_POOL_BYTES
+#error "S10077_RAM_POOL_BYTES cannot hold the tables of S10077_MAX_SENSORS sensors and the noise sums"
+#endif
+
+//================================================================================
+// Private Types
+//================================================================================
+typedef struct {
+    uint32_t prescaler;     // ADC_CLOCK_SYNC_PCLK_DIVx, shared by all ADCs
+    uint32_t sample_time;   // ADC_SAMPLETIME_xCYCLES
+    uint32_t delay;         // ADC_TWOSAMPLINGDELAY_xCYCLES between the interleaved ADCs
+    uint32_t sample_ns;     // From the ADC trigger to the end of the last sampling window of a pixel
+} AdcTiming;
+
+typedef struct {
+    S10077_OutputMode output_mode;
+    uint16_t          peak_threshold;
+    uint16_t          edge_level;
+    uint16_t          edge_hysteresis;
+    uint16_t          full_frame_interval;      // 0 = summary modes never send the full frame
+    uint32_t          summary_count;            // Summary records sent since the interval was set
+    uint32_t          ema_alpha_q16;            // 0 = temporal filter disabled
+    bool              ema_primed;               // ema_state holds a valid history
+    uint8_t           sg_window;                // 0 = Savitzky-Golay stage disabled
+    uint8_t           sg_derivative;
+    bool              resample_enabled;
+    bool              wl_calibrated;            // wl_positions holds a valid table
+    uint16_t          hist_bins;                // 0 = no histogram alongside the output
+    uint32_t          integration_us;
+    uint32_t          hdr_short_us;             // 0 = HDR bracketing disabled
+    uint32_t          hdr_long_us;
+    uint32_t          hdr_ratio_q8;             // long_us / short_us
+    bool              hdr_long_next;            // Exposure of the next HDR acquisition
+    bool              hdr_short_valid;          // hdr_short_frame holds the first half of a pair
+    S10077_ChangeMetric change_metric;
+    uint32_t          change_threshold;
+    uint16_t          change_heartbeat;         // 0 = no heartbeat
+    uint16_t          change_roi_start;
+    uint16_t          change_roi_length;        // 0 = whole frame
+    uint16_t          change_frames_since_sent;
+    bool              change_reference_valid;   // change_reference holds the last frame sent
+    uint32_t          frame_count;              // Number of acquisitions started on this sensor
+    S10077_Backpressure backpressure;
+    uint8_t           decimation;               // S10077_BACKPRESSURE_DECIMATE: keep one of this many frames
+    uint8_t           decimate_skipped;         // Frames skipped since the last one queued
+    uint32_t          dropped_frames;           // Frames discarded by the backpressure policy
+    uint32_t          period_us;                // 0 = not scheduled by S10077_ScheduleNext()
+    uint8_t           priority;
+    uint32_t          next_release_us;          // Release time of the next scheduled frame
+    uint32_t          sched_frames;             // Scheduler statistics since the last report
+    uint32_t          sched_skipped;
+    uint32_t          sched_lateness_sum_us;
+    uint32_t          sched_lateness_max_us;
+    uint32_t          sample_phase_ns;          // Delay from the TRG edge to the ADC trigger
+} S10077_SensorState;
+
 //================================================================================
 // Private Variables
 //================================================================================
 static TIM_HandleTypeDef* clk_tim_handle;
+static uint32_t pixel_clock_hz = 0;                 // Actual CLK frequency
+static AdcTiming adc_timing = { ADC_CLOCK_SYNC_PCLK_DIV4, ADC_SAMPLETIME_28CYCLES, ADC_TWOSAMPLINGDELAY_5CYCLES, 1245 }; // See S10077_SetPixelClock()
+static S10077_Resolution adc_resolution = S10077_RESOLUTION_12BIT;
+static ADC_HandleTypeDef* adc_slave_handle = NULL;  // Second ADC of the interleaved mode, NULL when off
+static uint8_t oversampling = 1;                    // Conversions per pixel, averaged into one value
+static uint16_t os_dma_buffer[2 * OS_BLOCK_PIXELS * S10077_MAX_OVERSAMPLING]; // Circular: two blocks of raw samples
+static uint16_t os_pixels_done = 0;                 // Pixels of the current frame averaged into adc_buffer
+static uint32_t trig_tim_period[S10077_MAX_SENSORS]; // Trigger timer periods saved by the interleaved mode
 static UART_HandleTypeDef* uart_handle;
 static const S10077_SensorConfig* sensor_configs;
 static uint8_t configured_sensor_count = 0;
 
-static uint16_t adc_buffer[S10077_NUM_PIXELS];
-static volatile bool data_ready_flag = false;
-static uint8_t current_sensor_id = 0;
-static ADC_HandleTypeDef* current_adc_handle = NULL; // Remember the currently active ADC handle
-static TIM_HandleTypeDef* current_tim_handle = NULL; // Remember the currently active TIM handle
+static uint16_t adc_buffer[S10077_NUM_PIXELS] __ALIGNED(4); // Word access by the SIMD statistics
+static volatile bool data_ready_flag = false;
+static uint8_t current_sensor_id = 0;
+static uint32_t frame_timestamp_us = 0;             // End of integration of the frame in adc_buffer
+static uint32_t frame_seq = 0;                      // Per-sensor sequence number of the frame in adc_buffer
+static ADC_HandleTypeDef* current_adc_handle = NULL; // Remember the currently active ADC handle
+static TIM_HandleTypeDef* current_tim_handle = NULL; // Remember the currently active TIM handle
+
+// Armed acquisitions: ST is asserted from a trigger or frame clock interrupt and released by a compare interrupt
+// of the trigger timer (or by S10077_IsDataReady() when no trigger timer is set)
+typedef enum { FRAME_START_FIRMWARE = 0, FRAME_START_EXTERNAL, FRAME_START_CLOCK } FrameStart;
+static volatile bool acq_armed = false;             // Acquisition prepared, waiting for its start event
+static volatile bool integrating = false;           // ST asserted by the start event, not yet released
+static uint32_t integration_start_cycles = 0;
+static uint32_t integration_cycles = 0;
+static TIM_HandleTypeDef* trigger_timer_handle = NULL; // CH1 captures TRIG_IN edges, CH2 ends integration
+static uint16_t integration_start_tick = 0;         // Trigger timer count when ST was asserted
+static uint32_t integration_ticks = 0;              // Integration time in trigger timer ticks
+static volatile uint32_t integration_ticks_left = 0; // Ticks not yet scheduled on CH2
+static volatile uint32_t ext_trigger_count = 0;     // Trigger edges seen
+static volatile uint32_t ext_missed_count = 0;      // Trigger edges that arrived while not armed
+static TIM_HandleTypeDef* frame_clock_handle = NULL; // Frame clock timer, NULL when stopped
+static volatile uint32_t clock_tick_count = 0;      // Frame clock ticks seen
+static volatile uint32_t clock_missed_count = 0;    // Ticks that arrived while not armed
+static FrameStart frame_start = FRAME_START_FIRMWARE; // How the frame in adc_buffer was started
+static uint32_t frame_event_count = 0;              // Trigger edge or clock tick that started it
+static uint32_t frame_trigger_latency_ns = 0;       // Trigger edge (or interrupt without a trigger timer) to ST assertion
+static uint32_t frame_missed_count = 0;             // Clock ticks missed up to that frame
+
+static uint32_t sched_report_start_us = 0;          // Start of the scheduler statistics interval
+
+static S10077_SensorState sensor_state[S10077_MAX_SENSORS];
+
+// RAM pool: tables of the configured sensors and the loaded LUTs from the bottom, the frame store above them
+static uint8_t ram_pool[S10077_RAM_POOL_BYTES] __ALIGNED(8);
+static uint32_t ram_pool_used = 0;
+static char tx_buffer[S10077_NUM_PIXELS * 6 + 100];
+static bool frame_processed = false;                // Processing stages already ran on adc_buffer
+static bool frame_resampled = false;                // adc_buffer holds wavelength-grid samples
+
+// ADC linearization tables, assigned to ADC instances on load
+static ADC_TypeDef* lut_adc[S10077_MAX_LUTS];
+static uint16_t* lut_table[S10077_MAX_LUTS];        // From the RAM pool on first load, NULL before
+
+// Histogram of the current frame
+static uint16_t histogram[S10077_DSP_MAX_HIST_BINS];
+static uint16_t histogram_bins = 0;                 // 0 = not computed for this frame
+
+// HDR bracketing: short-exposure frame waiting for its long partner, per sensor
+typedef enum { HDR_PHASE_NONE = 0, HDR_PHASE_SHORT, HDR_PHASE_LONG } HdrPhase;
+static uint16_t (*hdr_short_frame)[S10077_NUM_PIXELS];
+static HdrPhase frame_hdr_phase = HDR_PHASE_NONE;   // Exposure of the frame in adc_buffer
+static bool frame_hdr_merged = false;               // adc_buffer holds a merged pair, with values beyond 12 bits
+static bool frame_output_suppressed = false;        // Frame was consumed by a processing stage
+
+// Pull mode: most recent processed frame of every sensor, sent on request
+typedef struct {
+    uint32_t seq;
+    uint32_t timestamp_us;
+    bool     valid;
+    bool     resampled;
+    bool     hdr_merged;
+    S10077_Resolution resolution;
+    uint8_t  oversampling;
+} LatestFrameInfo;
+static uint16_t (*latest_frame)[S10077_NUM_PIXELS];
+static LatestFrameInfo latest_info[S10077_MAX_SENSORS];
+static bool pull_mode = false;                      // Frames are kept in latest_frame instead of being streamed
+static bool frame_replayed = false;                 // Frame in adc_buffer came from the frame store
+
+// Output queue: encoded records waiting for the UART, sent chunk by chunk from the transmit interrupt.
+// Byte and entry positions are free-running; entries are contiguous in tx_queue, oldest (on the wire) first.
+typedef struct {
+    uint32_t start;
+    uint16_t length;
+    uint8_t  sensor_id;                             // TX_CONTROL for records that are never dropped
+} TxEntry;
+static char tx_queue[S10077_TX_QUEUE_BYTES];
+static TxEntry tx_entries[TX_QUEUE_ENTRIES];
+static volatile uint32_t tx_entry_head = 0;         // Oldest entry, being sent
+static volatile uint32_t tx_entry_tail = 0;         // One past the newest complete entry
+static volatile uint32_t tx_wire_pos = 0;           // Next byte to send; everything before it is free
+static uint32_t tx_byte_tail = 0;                   // End of the queued bytes, including the open entry
+static volatile uint16_t tx_chunk = 0;              // Bytes of the transfer on the wire
+static volatile bool tx_busy = false;               // A chunk is on the wire
+static volatile bool tx_hold = false;               // Entries are being rearranged, do not start the next one
+static uint32_t tx_open_start = 0;                  // Start of the entry being assembled
+static uint8_t tx_open_sensor = TX_CONTROL;
+static S10077_Backpressure tx_open_policy = S10077_BACKPRESSURE_BLOCK;
+static bool tx_open = false;                        // An entry is being assembled (false after it was dropped)
+
+// Host command line, received byte by byte in the UART interrupt
+static uint8_t rx_byte;
+static char rx_line[HOST_LINE_MAX];
+static uint8_t rx_length = 0;
+static volatile bool rx_line_ready = false;         // rx_line holds a complete command
+
+// Change detection: last frame sent per sensor
+static uint16_t (*change_reference)[S10077_NUM_PIXELS];
+static bool frame_change_valid = false;             // frame_change holds the difference of the current frame
+static uint32_t frame_change = 0;
+
+// Temporal filter state, Q16 per pixel
+static uint32_t (*ema_state)[S10077_NUM_PIXELS];
+
+// Wavelength resampling: source pixel position (Q16) of every grid sample, per sensor
+static float wl_grid_start_nm = S10077_WL_GRID_START_NM;
+static float wl_grid_end_nm = S10077_WL_GRID_END_NM;
+static uint32_t (*wl_positions)[S10077_NUM_PIXELS];
+static uint16_t resample_buffer[S10077_NUM_PIXELS];
+
+// Savitzky-Golay output; holds the derived spectrum when a derivative is selected
+static int16_t sg_output[S10077_NUM_PIXELS];
+static bool derivative_valid = false;
+
+// Noise characterization (one sensor at a time), in the frame store arena while active
+static uint32_t* noise_sum = NULL;
+static uint64_t* noise_sum_sq = NULL;
+static volatile bool noise_active = false;
+static uint8_t noise_sensor_id = 0;
+static uint16_t noise_target_frames = 0;
+static uint16_t noise_frames = 0;
+
+// Pre-trigger capture (one sensor at a time, in the frame store)
+typedef enum { PRETRIG_OFF = 0, PRETRIG_ARMED, PRETRIG_POST, PRETRIG_DUMP } PreTriggerState;
+static PreTriggerState pretrig_state = PRETRIG_OFF;
+static uint8_t pretrig_sensor_id = 0;
+static S10077_StoreFormat pretrig_format = S10077_STORE_16BIT;
+static uint16_t pretrig_pre_frames = 0;
+static uint16_t pretrig_post_frames = 0;
+static uint16_t pretrig_post_count = 0;
+static uint16_t pretrig_level = 0;                  // 0 = level trigger disabled
+static volatile bool pretrig_request = false;       // Set by S10077_Trigger(), taken by the next frame
+static volatile uint32_t pretrig_request_us = 0;
+static volatile S10077_TriggerSource pretrig_request_source = S10077_TRIGGER_HOST;
+static uint32_t pretrig_time_us = 0;                // Trigger of the window being captured/sent
+static S10077_TriggerSource pretrig_source = S10077_TRIGGER_HOST;
+
+// Line scan: processed lines of one sensor assembled into tiles in the frame store
+static bool linescan_active = false;
+static uint8_t linescan_sensor_id = 0;
+static uint16_t linescan_lines = 0;
+static bool linescan_compress = false;
+static uint32_t linescan_tile_seq = 0;
+static bool linescan_sending = false;               // A complete tile is being sent, one line per output call
+static uint16_t linescan_send_line = 0;             // Next line of that tile
+
+//================================================================================
+// Private Helper Functions
+//================================================================================
+
+/**
+ * @brief  Takes a block from the bottom of the RAM pool and hands the rest to the frame store, which is emptied.
+ * The compile-time budget check guarantees that all tables fit.
+ */
+static void* pool_alloc(uint32_t bytes)
+{
+    void* block = &ram_pool[ram_pool_used];
+    ram_pool_used += (bytes + 7u) & ~7u;
+    S10077_FrameStore_Init(&ram_pool[ram_pool_used], S10077_RAM_POOL_BYTES - ram_pool_used);
+    return block;
+}
+
+/**
+ * @brief  Returns true while frames in the store, or the moment sums borrowing it, must be kept.
+ */
+static bool frame_store_in_use(void)
+{
+    return linescan_active || pretrig_state != PRETRIG_OFF || noise_active || S10077_FrameStore_Count() != 0;
+}
+
+/**
+ * @brief  Borrows the frame store arena for the noise moment sums and clears them.
+ * @retval false if the store is in use.
+ */
+static bool borrow_noise_sums(void)
+{
+    if (frame_store_in_use()) {
+        return false;
+    }
+    uint8_t* scratch = S10077_FrameStore_Borrow(NOISE_SUMS_BYTES);
+    if (scratch == NULL) {
+        return false;
+    }
+    memset(scratch, 0, NOISE_SUMS_BYTES);
+    noise_sum_sq = (uint64_t*)scratch;
+    noise_sum = (uint32_t*)(scratch + S10077_NUM_PIXELS * sizeof(uint64_t));
+    return true;
+}
+
+/**
+ * @brief  Returns the arena borrowed by borrow_noise_sums() to the frame store.
+ */
+static void return_noise_sums(void)
+{
+    noise_sum = NULL;
+    noise_sum_sq = NULL;
+    S10077_FrameStore_Reset(S10077_STORE_16BIT);
+}
+
+/**
+ * @brief  Returns the time since boot in microseconds, derived from the HAL tick and the SysTick counter.
+ * Safe to call from interrupts that block the SysTick handler: a counter wrap whose tick interrupt is still
+ * pending is counted as the millisecond HAL_GetTick() has not seen yet.
+ */
+static uint32_t get_timestamp_us(void)
+{
+    uint32_t ms;
+    uint32_t val;
+
+    // Re-read if the millisecond tick (including a pending one) advanced while sampling the counter
+    do {
+        ms = HAL_GetTick();
+        val = SysTick->VAL;
+        if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+            // The counter wrapped (possibly just after the read above): sample it again past the wrap
+            val = SysTick->VAL;
+            ms++;
+        }
+    } while (ms != HAL_GetTick() + ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) ? 1u : 0u));
+
+    uint32_t load = SysTick->LOAD + 1;
+    return ms * 1000 + ((load - 1 - val) * 1000) / load;
+}
+
+/**
+ * @brief  Returns the input clock of a timer (timers run at twice their APB clock unless the APB is undivided).
+ */
+static uint32_t timer_clock_hz(const TIM_HandleTypeDef* htim)
+{
+    const TIM_TypeDef* tim = htim->Instance;
+
+    if (tim == TIM1 || tim == TIM8 || tim == TIM9 || tim == TIM10 || tim == TIM11) {
+        uint32_t pclk2 = HAL_RCC_GetPCLK2Freq();
+        return ((RCC->CFGR & RCC_CFGR_PPRE2) == RCC_HCLK_DIV1) ? pclk2 : pclk2 * 2;
+    }
+    uint32_t pclk1 = HAL_RCC_GetPCLK1Freq();
+    return ((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_HCLK_DIV1) ? pclk1 : pclk1 * 2;
+}
+
+/**
+ * @brief  Returns the number of bits converted at an ADC resolution; also its successive approximation cycles.
+ */
+static uint8_t resolution_bits(S10077_Resolution resolution)
+{
+    switch (resolution) {
+    case S10077_RESOLUTION_10BIT: return 10;
+    case S10077_RESOLUTION_8BIT:  return 8;
+    case S10077_RESOLUTION_12BIT:
+    default:                      return 12;
+    }
+}
+
+/**
+ * @brief  Picks the ADC prescaler and sampling time for a pixel clock: the longest sampling time
+ * (lowest noise) whose conversion still fits into one pixel period, leaving ADC_TIMING_MARGIN_PCT free.
+ * In interleaved mode each ADC has two pixel periods per conversion, the second ADC starts exactly one pixel
+ * period after the first (5 to 20 ADC clocks), and the sampling phases of the two ADCs must not overlap.
+ * With oversampling, all conversions of a pixel must fit into its period.
+ * @param  clock_hz: Pixel clock.
+ * @param  resolution: ADC resolution, which sets the conversion cycles after sampling.
+ * @param  interleaved: Timing for the dual-ADC interleaved mode.
+ * @param  conversions: Conversions per pixel (oversampling factor).
+ * @param  timing: Output prescaler, sampling time and interleaving delay.
+ * @retval false if not even the shortest sampling time fits.
+ */
+static bool select_adc_timing(uint32_t clock_hz, S10077_Resolution resolution, bool interleaved, uint8_t conversions,
+                              AdcTiming* timing)
+{
+    static const uint32_t prescalers[] = { ADC_CLOCK_SYNC_PCLK_DIV2, ADC_CLOCK_SYNC_PCLK_DIV4,
+                                           ADC_CLOCK_SYNC_PCLK_DIV6, ADC_CLOCK_SYNC_PCLK_DIV8 };
+    static const uint8_t dividers[] = { 2, 4, 6, 8 };
+    static const uint32_t sample_times[] = { ADC_SAMPLETIME_3CYCLES, ADC_SAMPLETIME_15CYCLES, ADC_SAMPLETIME_28CYCLES,
+                                             ADC_SAMPLETIME_56CYCLES, ADC_SAMPLETIME_84CYCLES, ADC_SAMPLETIME_112CYCLES,
+                                             ADC_SAMPLETIME_144CYCLES, ADC_SAMPLETIME_480CYCLES };
+    static const uint16_t sample_cycles[] = { 3, 15, 28, 56, 84, 112, 144, 480 };
+    uint32_t pclk2 = HAL_RCC_GetPCLK2Freq();
+    uint32_t conversion_cycles = resolution_bits(resolution);
+    uint32_t periods = interleaved ? 2 : 1;
+    uint32_t best_cycles = 0;
+    uint32_t best_adc_hz = 1;
+
+    if (clock_hz == 0) {
+        return false;
+    }
+    for (int p = 0; p < 4; p++) {
+        uint32_t adc_hz = pclk2 / dividers[p];
+        uint32_t delay_cycles = 0;
+        if (adc_hz > ADC_CLOCK_MAX_HZ) {
+            continue;
+        }
+        if (interleaved) {
+            delay_cycles = adc_hz / clock_hz;
+            if (delay_cycles * clock_hz != adc_hz || delay_cycles < 5 || delay_cycles > 20) {
+                continue;
+            }
+        }
+        for (int s = 7; s >= 0; s--) {
+            if (interleaved && sample_cycles[s] > delay_cycles) {
+                continue;
+            }
+            // conversions * (sample + conversion) / adc_hz <= (100 - margin)% of periods / clock_hz
+            uint64_t busy = (uint64_t)(sample_cycles[s] + conversion_cycles) * conversions * clock_hz * 100;
+            if (busy > (uint64_t)adc_hz * periods * (100 - ADC_TIMING_MARGIN_PCT)) {
+                continue;
+            }
+            // Longer sampling time wins; on a tie the faster ADC clock found first is kept
+            if ((uint64_t)sample_cycles[s] * best_adc_hz > (uint64_t)best_cycles * adc_hz) {
+                best_cycles = sample_cycles[s];
+                best_adc_hz = adc_hz;
+                timing->prescaler = prescalers[p];
+                timing->sample_time = sample_times[s];
+                timing->delay = interleaved ? ((delay_cycles - 5) << ADC_CCR_DELAY_Pos) : ADC_TWOSAMPLINGDELAY_5CYCLES;
+                timing->sample_ns = (uint32_t)(((uint64_t)(conversions - 1) * (sample_cycles[s] + conversion_cycles) +
+                                                sample_cycles[s]) * 1000000000u / adc_hz) + 1;
+            }
+            break;
+        }
+    }
+    return best_cycles != 0;
+}
+
+/**
+ * @brief  Writes a timing chosen by select_adc_timing() to the common ADC registers and the handles.
+ */
+static void apply_adc_timing(const AdcTiming* timing)
+{
+    MODIFY_REG(ADC_COMMON_REGISTER(sensor_configs[0].adc_handle)->CCR, ADC_CCR_ADCPRE | ADC_CCR_DELAY,
+               timing->prescaler | timing->delay);
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        sensor_configs[i].adc_handle->Init.ClockPrescaler = timing->prescaler;
+    }
+    if (adc_slave_handle != NULL) {
+        adc_slave_handle->Init.ClockPrescaler = timing->prescaler;
+    }
+    adc_timing = *timing;
+}
+
+/**
+ * @brief  Stops the ADC and DMA of the current acquisition.
+ */
+static void stop_adc(void)
+{
+    if (adc_slave_handle != NULL) {
+        HAL_ADCEx_MultiModeStop_DMA(current_adc_handle);
+    } else {
+        HAL_ADC_Stop_DMA(current_adc_handle);
+    }
+}
+
+/**
+ * @brief  Returns true while an acquisition is armed, integrating or being read out.
+ */
+static bool acquisition_busy(void)
+{
+    return acq_armed || integrating ||
+           (current_adc_handle != NULL && (HAL_ADC_GetState(current_adc_handle) & HAL_ADC_STATE_REG_BUSY));
+}
+
+/**
+ * @brief  Returns the longest TRG-to-ADC delay whose sampling still ends within the pixel period.
+ */
+static uint32_t max_sample_phase_ns(void)
+{
+    uint32_t period_ns = 1000000000u / pixel_clock_hz;
+    return (period_ns > adc_timing.sample_ns) ? period_ns - adc_timing.sample_ns : 0;
+}
+
+/**
+ * @brief  Sets the delay between the TRG edge and the ADC trigger of a trigger timer.
+ * Without a delay the counter reset on the TRG edge itself triggers the ADC (TRGO = update, counter stopped).
+ * With a delay the timer runs one pulse per TRG edge: trigger slave mode starts the stopped counter from 0, TRGO
+ * follows OC2REF in PWM mode 1, which falls (the ADC trigger edge) at CCR2, and the counter stops at 0 again on
+ * the overflow at ARR = CCR2 + 1. OC2REF stays high while stopped, so each TRG edge triggers exactly one conversion.
+ * @param  htim: Trigger timer.
+ * @param  phase_ns: Delay, limited to max_sample_phase_ns().
+ */
+static void apply_sample_phase(TIM_HandleTypeDef* htim, uint32_t phase_ns)
+{
+    uint32_t max_ns = max_sample_phase_ns();
+    if (phase_ns > max_ns) {
+        phase_ns = max_ns;
+    }
+    uint32_t ticks = (uint32_t)(((uint64_t)phase_ns * timer_clock_hz(htim) + 500000000u) / 1000000000u);
+
+    __HAL_TIM_DISABLE(htim);
+    __HAL_TIM_SET_COUNTER(htim, 0);
+    if (ticks == 0) {
+        CLEAR_BIT(htim->Instance->CR1, TIM_CR1_OPM);
+        MODIFY_REG(htim->Instance->SMCR, TIM_SMCR_SMS, TIM_SLAVEMODE_RESET);
+        MODIFY_REG(htim->Instance->CR2, TIM_CR2_MMS, TIM_TRGO_UPDATE);
+        __HAL_TIM_SET_AUTORELOAD(htim, htim->Init.Period);
+        return;
+    }
+    MODIFY_REG(htim->Instance->CCMR1, TIM_CCMR1_CC2S | TIM_CCMR1_OC2M | TIM_CCMR1_OC2PE, TIM_OCMODE_PWM1 << 8);
+    __HAL_TIM_SET_COMPARE(htim, TIM_CHANNEL_2, ticks);
+    __HAL_TIM_SET_AUTORELOAD(htim, ticks + 1);
+    MODIFY_REG(htim->Instance->CR2, TIM_CR2_MMS, TIM_TRGO_OC2REF);
+    SET_BIT(htim->Instance->CR1, TIM_CR1_OPM);
+    MODIFY_REG(htim->Instance->SMCR, TIM_SMCR_SMS, TIM_SLAVEMODE_TRIGGER);
+}
+
+/**
+ * @brief  Scales a frame converted at reduced resolution to the 12-bit range used by all processing stages.
+ * The top bits are replicated into the new low bits, so full scale stays 4095.
+ */
+static void expand_to_12bit(uint16_t* frame, uint16_t length)
+{
+    uint8_t bits = resolution_bits(adc_resolution);
+    uint8_t shift = 12 - bits;
+
+    for (uint16_t i = 0; i < length; i++) {
+        frame[i] = (uint16_t)((frame[i] << shift) | (frame[i] >> (bits - shift)));
+    }
+}
+
+/**
+ * @brief  Averages one block of the oversampling DMA buffer into the next pixels of adc_buffer.
+ * Each pixel's conversions are consecutive in the buffer (one scan sequence per TRG edge).
+ * @param  samples: Half of os_dma_buffer that the DMA has just filled.
+ */
+static void average_oversampled_block(const uint16_t* samples)
+{
+    uint16_t* out = &adc_buffer[os_pixels_done];
+
+    for (uint16_t i = 0; i < OS_BLOCK_PIXELS; i++) {
+        uint32_t sum = 0;
+        for (uint8_t k = 0; k < oversampling; k++) {
+            sum += *samples++;
+        }
+        out[i] = (uint16_t)((sum + oversampling / 2) / oversampling);
+    }
+    os_pixels_done += OS_BLOCK_PIXELS;
+}
+
+/**
+ * @brief  Returns the frame store format to use: 8-bit frames are always stored as bytes.
+ */
+static S10077_StoreFormat store_format_for(S10077_StoreFormat format)
+{
+    return (adc_resolution == S10077_RESOLUTION_8BIT) ? S10077_STORE_8BIT : format;
+}
+
+/**
+ * @brief  Busy-waits for the given number of microseconds using the DWT cycle counter.
+ */
+static void delay_us(uint32_t us)
+{
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles = us * (SystemCoreClock / 1000000u);
+    while ((DWT->CYCCNT - start) < cycles) {
+    }
+}
+
+/**
+ * @brief  Starts the next chunk of the oldest queued entry, retiring entries that are completely sent.
+ * Called from the transmit interrupt, and from the main loop when nothing is on the wire.
+ */
+static void tx_start_next_chunk(void)
+{
+    while (tx_entry_head != tx_entry_tail && !tx_hold) {
+        const TxEntry* entry = &tx_entries[tx_entry_head % TX_QUEUE_ENTRIES];
+        uint32_t end = entry->start + entry->length;
+        if (tx_wire_pos != end) {
+            uint32_t offset = tx_wire_pos % S10077_TX_QUEUE_BYTES;
+            uint32_t chunk = end - tx_wire_pos;
+            if (chunk > TX_CHUNK_BYTES) {
+                chunk = TX_CHUNK_BYTES;
+            }
+            if (chunk > S10077_TX_QUEUE_BYTES - offset) {
+                chunk = S10077_TX_QUEUE_BYTES - offset;
+            }
+            tx_chunk = (uint16_t)chunk;
+            tx_busy = true;
+            if (HAL_UART_Transmit_IT(uart_handle, (uint8_t*)&tx_queue[offset], (uint16_t)chunk) != HAL_OK) {
+                tx_busy = false;   // Retried by the next tx_kick()
+            }
+            return;
+        }
+        tx_entry_head++;
+    }
+    tx_busy = false;
+}
+
+/**
+ * @brief  Starts transmission if the queue was idle. Called from the main loop only.
+ */
+static void tx_kick(void)
+{
+    // A UART that is idle while a chunk is marked on the wire lost its completion interrupt
+    if (tx_busy && uart_handle->gState == HAL_UART_STATE_READY) {
+        tx_busy = false;
+    }
+    if (!tx_busy) {
+        tx_start_next_chunk();
+    }
+}
+
+/**
+ * @brief  Returns true if n more bytes fit into the output queue.
+ */
+static bool tx_has_room(int n)
+{
+    return (S10077_TX_QUEUE_BYTES - (tx_byte_tail - tx_wire_pos)) >= (uint32_t)n &&
+           (tx_entry_tail - tx_entry_head) < TX_QUEUE_ENTRIES;
+}
+
+/**
+ * @brief  Returns true if the queue holds an entry of the sensor, including the one on the wire.
+ */
+static bool tx_sensor_queued(uint8_t sensor_id)
+{
+    for (uint32_t e = tx_entry_head; e != tx_entry_tail; e++) {
+        if (tx_entries[e % TX_QUEUE_ENTRIES].sensor_id == sensor_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief  Removes the sensor's oldest entry that has not started sending, moving the later bytes down.
+ * @retval false if the sensor has no such entry.
+ */
+static bool tx_drop_oldest(uint8_t sensor_id)
+{
+    bool dropped = false;
+
+    // Hold first, so the transmit interrupt cannot retire the head entry under the snapshot
+    tx_hold = true;
+    uint32_t queued = tx_entry_tail - tx_entry_head;
+    // The head entry is on the wire (or about to be) and cannot be recalled
+    for (uint32_t i = 1; i < queued; i++) {
+        uint32_t e = tx_entry_head + i;
+        TxEntry* entry = &tx_entries[e % TX_QUEUE_ENTRIES];
+        if (entry->sensor_id != sensor_id) {
+            continue;
+        }
+        uint32_t length = entry->length;
+        for (uint32_t k = entry->start + length; k != tx_byte_tail; k++) {
+            tx_queue[(k - length) % S10077_TX_QUEUE_BYTES] = tx_queue[k % S10077_TX_QUEUE_BYTES];
+        }
+        for (uint32_t f = e; f + 1 != tx_entry_tail; f++) {
+            tx_entries[f % TX_QUEUE_ENTRIES] = tx_entries[(f + 1) % TX_QUEUE_ENTRIES];
+            tx_entries[f % TX_QUEUE_ENTRIES].start -= length;
+        }
+        tx_entry_tail--;
+        tx_byte_tail -= length;
+        tx_open_start -= length;
+        dropped = true;
+        break;
+    }
+    tx_hold = false;
+    tx_kick();
+    return dropped;
+}
+
+/**
+ * @brief  Opens a queue entry for a frame of the current sensor, or for a control record.
+ * @param  sensor_id: Owner of the entry, or TX_CONTROL.
+ * @param  policy: Backpressure policy applied while the entry is filled.
+ * @retval false if the frame is dropped by decimation.
+ */
+static bool tx_open_entry(uint8_t sensor_id, S10077_Backpressure policy)
+{
+    if (sensor_id != TX_CONTROL && policy == S10077_BACKPRESSURE_DECIMATE) {
+        S10077_SensorState* state = &sensor_state[sensor_id];
+        // Only while the link is behind, i.e. an earlier frame of the sensor is still queued
+        if (tx_sensor_queued(sensor_id) && ++state->decimate_skipped < state->decimation) {
+            state->dropped_frames++;
+            return false;
+        }
+        state->decimate_skipped = 0;
+    }
+    tx_open_start = tx_byte_tail;
+    tx_open_sensor = sensor_id;
+    tx_open_policy = (sensor_id == TX_CONTROL) ? S10077_BACKPRESSURE_BLOCK : policy;
+    tx_open = true;
+    return true;
+}
+
+/**
+ * @brief  Appends the first n bytes of tx_buffer to the open entry. When the queue is full the entry's
+ * policy decides: wait for the UART, discard older frames of the sensor, or discard this frame.
+ * @retval false if the entry was dropped; the caller stops encoding the frame.
+ */
+static bool tx_append(int n)
+{
+    if (!tx_open) {
+        return false;
+    }
+    uint32_t wait_start = HAL_GetTick();
+    while (!tx_has_room(n)) {
+        if (tx_open_policy == S10077_BACKPRESSURE_BLOCK && tx_entry_head != tx_entry_tail &&
+            (HAL_GetTick() - wait_start) < TX_BLOCK_TIMEOUT_MS) {
+            tx_kick();  // Space is released by the transmit interrupt; restart it if a transfer failed
+            continue;
+        }
+        if (tx_open_policy == S10077_BACKPRESSURE_DROP_OLDEST && tx_drop_oldest(tx_open_sensor)) {
+            sensor_state[tx_open_sensor].dropped_frames++;
+            continue;
+        }
+        // Drop the new entry (also a blocking one that could never fit or timed out)
+        tx_byte_tail = tx_open_start;
+        if (tx_open_sensor != TX_CONTROL) {
+            sensor_state[tx_open_sensor].dropped_frames++;
+        }
+        tx_open = false;
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        tx_queue[(tx_byte_tail + i) % S10077_TX_QUEUE_BYTES] = tx_buffer[i];
+    }
+    tx_byte_tail += n;
+    return true;
+}
+
+/**
+ * @brief  Completes the open entry and hands it to the transmit interrupt.
+ */
+static void tx_commit(void)
+{
+    if (!tx_open) {
+        return;
+    }
+    tx_open = false;
+    if (tx_byte_tail == tx_open_start) {
+        return;
+    }
+    TxEntry* entry = &tx_entries[tx_entry_tail % TX_QUEUE_ENTRIES];
+    entry->start = tx_open_start;
+    entry->length = (uint16_t)(tx_byte_tail - tx_open_start);
+    entry->sensor_id = tx_open_sensor;
+    tx_entry_tail++;
+    tx_kick();
+}
+
+/**
+ * @brief  Queues the first n bytes of tx_buffer as a record that is never dropped, waiting for space if needed.
+ */
+static void send_record(int n)
+{
+    tx_open_entry(TX_CONTROL, S10077_BACKPRESSURE_BLOCK);
+    tx_append(n);
+    tx_commit();
+}
+
+/**
+ * @brief  Evaluates a sensor's calibration polynomial at a pixel position (Horner scheme).
+ */
+static float pixel_to_wavelength(const float* coeffs, float pixel)
+{
+    float wl = coeffs[S10077_WL_COEFFS - 1];
+    for (int c = S10077_WL_COEFFS - 2; c >= 0; c--) {
+        wl = wl * pixel + coeffs[c];
+    }
+    return wl;
+}
+
+/**
+ * @brief  Builds the fixed-point interpolation table mapping grid samples to source pixel positions.
+ * The calibration must be monotonic over the sensor; both increasing and decreasing are handled.
+ */
+static void build_wavelength_table(uint8_t sensor_id)
+{
+    const float* coeffs = sensor_configs[sensor_id].wavelength_coeffs;
+    uint32_t* positions = wl_positions[sensor_id];
+
+    sensor_state[sensor_id].wl_calibrated = (coeffs != NULL);
+    if (coeffs == NULL) {
+        return;
+    }
+
+    // Walk the pixels in the direction of increasing wavelength with parameter t
+    bool ascending = pixel_to_wavelength(coeffs, S10077_NUM_PIXELS - 1) > pixel_to_wavelength(coeffs, 0);
+    float step = (wl_grid_end_nm - wl_grid_start_nm) / (S10077_NUM_PIXELS - 1);
+    int t = 0;
+    float wl_lo = pixel_to_wavelength(coeffs, ascending ? 0 : S10077_NUM_PIXELS - 1);
+    float wl_hi = pixel_to_wavelength(coeffs, ascending ? 1 : S10077_NUM_PIXELS - 2);
+
+    for (int k = 0; k < S10077_NUM_PIXELS; k++)
+    {
+        float wl = wl_grid_start_nm + step * k;
+        while (wl > wl_hi && t < S10077_NUM_PIXELS - 2) {
+            t++;
+            wl_lo = wl_hi;
+            wl_hi = pixel_to_wavelength(coeffs, ascending ? t + 1 : S10077_NUM_PIXELS - 2 - t);
+        }
+        if (wl < wl_lo || wl > wl_hi) {
+            positions[k] = S10077_DSP_POSITION_INVALID;
+            continue;
+        }
+        float fraction = (wl_hi > wl_lo) ? (wl - wl_lo) / (wl_hi - wl_lo) : 0.0f;
+        float pixel = ascending ? (t + fraction) : (S10077_NUM_PIXELS - 1 - t - fraction);
+        positions[k] = (uint32_t)(pixel * 65536.0f + 0.5f);
+    }
+}
+
+/**
+ * @brief  Appends a float with four decimals, without relying on printf float support.
+ */
+static int append_float4(int n, float value)
+{
+    const char* sign = (value < 0.0f) ? "-" : "";
+    if (value < 0.0f) {
+        value = -value;
+    }
+    uint32_t scaled = (uint32_t)(value * 10000.0f + 0.5f);
+    return n + snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%s%lu.%04lu", sign,
+                        (unsigned long)(scaled / 10000), (unsigned long)(scaled % 10000));
+}
+
+/**
+ * @brief  Appends a Q8 fixed-point value as a decimal with two fraction digits (e.g. "512.37,").
+ */
+static int append_q8(int n, uint32_t value_q8)
+{
+    uint32_t integer = value_q8 >> 8;
+    uint32_t hundredths = ((value_q8 & 0xFF) * 100 + 128) >> 8;
+    if (hundredths == 100) {
+        integer++;
+        hundredths = 0;
+    }
+    return n + snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%lu.%02lu,",
+                        (unsigned long)integer, (unsigned long)hundredths);
+}
+
+/**
+ * @brief  Starts a summary record of the current frame in tx_buffer: "{tag},SENSOR_[ID],{seq},{timestamp_us},{dropped},".
+ * @retval Number of bytes in tx_buffer.
+ */
+static int begin_summary_record(const char* tag)
+{
+    return snprintf(tx_buffer, sizeof(tx_buffer), "%s,SENSOR_%u,%lu,%lu,%lu,", tag, current_sensor_id,
+                    (unsigned long)frame_seq, (unsigned long)frame_timestamp_us,
+                    (unsigned long)sensor_state[current_sensor_id].dropped_frames);
+}
+
+/**
+ * @brief  Appends the pixel data of a frame and the closing "END\r\n". Oversampled frames are preceded by an
+ * "OS_[factor]" token. At reduced resolution a "RES_[bits]" token comes first and the pixels are sent as native
+ * ADC codes; 8-bit frames (unless HDR-merged) are sent as a single field of two hex digits per pixel.
+ * @param  n: Bytes already in tx_buffer.
+ * @param  frame: Pixel data on the 12-bit scale.
+ * @param  resolution: ADC resolution the frame was converted at.
+ * @param  factor: Conversions averaged per pixel.
+ * @param  hdr_merged: The frame holds HDR-merged values beyond 12 bits.
+ * @retval Number of bytes in tx_buffer.
+ */
+static int append_pixels(int n, const uint16_t* frame, S10077_Resolution resolution, uint8_t factor, bool hdr_merged)
+{
+    static const char hex_digits[] = "0123456789abcdef";
+    uint8_t bits = resolution_bits(resolution);
+    uint8_t shift = 12 - bits;
+
+    if (factor > 1) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "OS_%u,", factor);
+    }
+    if (resolution != S10077_RESOLUTION_12BIT) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "RES_%u,", bits);
+    }
+    if (resolution == S10077_RESOLUTION_8BIT && !hdr_merged) {
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            uint16_t code = frame[i] >> shift;
+            if (code > 0xFF) {
+                code = 0xFF;
+            }
+            tx_buffer[n++] = hex_digits[code >> 4];
+            tx_buffer[n++] = hex_digits[code & 0x0F];
+        }
+        tx_buffer[n++] = ',';
+    } else {
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            if (n >= (sizeof(tx_buffer) - 10)) {
+                break;
+            }
+            n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", frame[i] >> shift);
+        }
+    }
+    if (n < (sizeof(tx_buffer) - 6)) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    }
+    return n;
+}
+
+/**
+ * @brief  Encodes the full frame as "BEGIN,SENSOR_[ID],SEQ_[seq],TS_[timestamp_us],{data...},END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_raw_frame(void)
+{
+    int n = 0;
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "BEGIN,SENSOR_%u,SEQ_%lu,TS_%lu,", current_sensor_id,
+                  (unsigned long)frame_seq, (unsigned long)frame_timestamp_us);
+    if (frame_start == FRAME_START_EXTERNAL) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "TRIG_%lu,TRIGLAT_%lu,",
+                      (unsigned long)frame_event_count, (unsigned long)frame_trigger_latency_ns);
+    } else if (frame_start == FRAME_START_CLOCK) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "TICK_%lu,MISSED_%lu,",
+                      (unsigned long)frame_event_count, (unsigned long)frame_missed_count);
+    }
+    if (frame_change_valid) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "CHANGE_%lu,", (unsigned long)frame_change);
+    }
+    // Also under BLOCK once a timed-out wait has dropped a frame
+    if (sensor_state[current_sensor_id].backpressure != S10077_BACKPRESSURE_BLOCK ||
+        sensor_state[current_sensor_id].dropped_frames != 0) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "DROP_%lu,",
+                      (unsigned long)sensor_state[current_sensor_id].dropped_frames);
+    }
+    if (frame_hdr_merged) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "HDR_");
+        n = append_q8(n, sensor_state[current_sensor_id].hdr_ratio_q8);
+    }
+    if (frame_resampled) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "WLSTART_");
+        n = append_float4(n, wl_grid_start_nm);
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, ",WLEND_");
+        n = append_float4(n, wl_grid_end_nm);
+        tx_buffer[n++] = ',';
+    }
+    return append_pixels(n, adc_buffer, adc_resolution, oversampling, frame_hdr_merged);
+}
+
+/**
+ * @brief  Encodes a sensor's latest frame as "BEGIN,SENSOR_[ID],SEQ_[seq],TS_[timestamp_us],AGE_[us],{data...},END\r\n",
+ * with the same optional header tokens as a streamed RAW frame.
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_latest_frame(uint8_t sensor_id)
+{
+    const LatestFrameInfo* info = &latest_info[sensor_id];
+    const uint16_t* frame = latest_frame[sensor_id];
+    int n = 0;
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "BEGIN,SENSOR_%u,SEQ_%lu,TS_%lu,AGE_%lu,", sensor_id,
+                  (unsigned long)info->seq, (unsigned long)info->timestamp_us,
+                  (unsigned long)(get_timestamp_us() - info->timestamp_us));
+    if (info->hdr_merged) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "HDR_");
+        n = append_q8(n, sensor_state[sensor_id].hdr_ratio_q8);
+    }
+    if (info->resampled) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "WLSTART_");
+        n = append_float4(n, wl_grid_start_nm);
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, ",WLEND_");
+        n = append_float4(n, wl_grid_end_nm);
+        tx_buffer[n++] = ',';
+    }
+    return append_pixels(n, frame, info->resolution, info->oversampling, info->hdr_merged);
+}
+
+/**
+ * @brief  Encodes the derived spectrum as "DERIV,SENSOR_[ID],{order},{data...},END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_derivative(void)
+{
+    int n = 0;
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "DERIV,SENSOR_%u,%u,",
+                  current_sensor_id, sensor_state[current_sensor_id].sg_derivative);
+    for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+        if (n >= (sizeof(tx_buffer) - 10)) {
+            break;
+        }
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%d,", sg_output[i]);
+    }
+    if (n < (sizeof(tx_buffer) - 6)) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    }
+    return n;
+}
+
+/**
+ * @brief  Encodes the frame histogram as "HIST,SENSOR_[ID],{seq},{timestamp_us},{dropped},{bins},{counts...},END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_histogram(void)
+{
+    int n = begin_summary_record("HIST");
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", histogram_bins);
+    for (uint16_t b = 0; b < histogram_bins; b++) {
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", histogram[b]);
+    }
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    return n;
+}
+
+/**
+ * @brief  Runs peak detection on the frame and encodes the result as
+ * "PEAKS,SENSOR_[ID],{seq},{timestamp_us},{dropped},{count},{position,height,width}...,END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_peaks(void)
+{
+    S10077_Peak peaks[S10077_DSP_MAX_PEAKS];
+    uint8_t count = S10077_DSP_FindPeaks(adc_buffer, S10077_NUM_PIXELS,
+                                         sensor_state[current_sensor_id].peak_threshold,
+                                         peaks, S10077_DSP_MAX_PEAKS);
+    int n = begin_summary_record("PEAKS");
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", count);
+    for (uint8_t p = 0; p < count; p++) {
+        n = append_q8(n, peaks[p].position_q8);
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", peaks[p].height);
+        n = append_q8(n, peaks[p].width_q8);
+    }
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    return n;
+}
+
+/**
+ * @brief  Runs edge detection on the frame and encodes the result as
+ * "EDGES,SENSOR_[ID],{seq},{timestamp_us},{dropped},{count},{+rising|-falling position}...,END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_edges(void)
+{
+    const S10077_SensorState* state = &sensor_state[current_sensor_id];
+    S10077_Edge edges[S10077_DSP_MAX_EDGES];
+    uint8_t count = S10077_DSP_FindEdges(adc_buffer, S10077_NUM_PIXELS, state->edge_level,
+                                         state->edge_hysteresis, edges, S10077_DSP_MAX_EDGES);
+    int n = begin_summary_record("EDGES");
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", count);
+    for (uint8_t e = 0; e < count; e++) {
+        tx_buffer[n++] = (edges[e].polarity > 0) ? '+' : '-';
+        n = append_q8(n, edges[e].position_q8);
+    }
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    return n;
+}
+
+/**
+ * @brief  Computes the frame statistics and encodes them as
+ * "STATS,SENSOR_[ID],{seq},{timestamp_us},{dropped},{sum},{min},{max},{argmax},{mean},{saturated},END\r\n".
+ * @retval Number of bytes written to tx_buffer.
+ */
+static int encode_stats(void)
+{
+    S10077_FrameStats stats;
+    // In a merged frame only pixels whose short exposure saturated are saturated
+    uint16_t saturation = frame_hdr_merged ?
+        (uint16_t)((S10077_SATURATION_LEVEL * sensor_state[current_sensor_id].hdr_ratio_q8 + 128) >> 8) :
+        S10077_SATURATION_LEVEL;
+    S10077_DSP_ComputeStats(adc_buffer, S10077_NUM_PIXELS, saturation, &stats);
+    int n = begin_summary_record("STATS");
+
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%lu,%u,%u,%u,",
+                  (unsigned long)stats.sum, stats.min, stats.max, stats.argmax);
+    n = append_q8(n, stats.mean_q8);
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,END\r\n", stats.saturated);
+    return n;
+}
+
+/**
+ * @brief  Sends one noise result vector, flushing tx_buffer whenever it fills up.
+ * @param  tag: Record tag ("NOISE_MEAN" or "NOISE_VAR").
+ * @param  send_variance: false for the mean vector, true for the variance vector.
+ */
+static void send_noise_vector(const char* tag, bool send_variance)
+{
+    int n = snprintf(tx_buffer, sizeof(tx_buffer), "%s,SENSOR_%u,%u,", tag, noise_sensor_id, noise_frames);
+
+    for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+        uint32_t mean_q8;
+        uint32_t variance_q8;
+        S10077_DSP_MomentsToQ8(noise_sum[i], noise_sum_sq[i], noise_frames, &mean_q8, &variance_q8);
+        n = append_q8(n, send_variance ? variance_q8 : mean_q8);
+        if (n >= (int)sizeof(tx_buffer) - 32) {
+            send_record(n);
+            n = 0;
+        }
+    }
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    send_record(n);
+}
+
+/**
+ * @brief  Returns the linearization table loaded for an ADC, or NULL.
+ */
+static const uint16_t* lut_for_adc(const ADC_TypeDef* instance)
+{
+    for (uint8_t t = 0; t < S10077_MAX_LUTS; t++) {
+        if (lut_adc[t] != NULL && lut_adc[t] == instance) {
+            return lut_table[t];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief  Runs the per-frame processing stages on adc_buffer, exactly once per acquisition.
+ */
+static void process_frame(void)
+{
+    if (frame_processed) {
+        return;
+    }
+    frame_processed = true;
+
+    if (adc_slave_handle == NULL) {
+        const uint16_t* lut = lut_for_adc(current_adc_handle->Instance);
+        if (lut != NULL) {
+            S10077_DSP_ApplyLUT(adc_buffer, S10077_NUM_PIXELS, lut);
+        }
+    } else {
+        // Interleaved: even pixels were converted by the master, odd pixels by ADC2
+        for (uint8_t a = 0; a < 2; a++) {
+            const uint16_t* lut = lut_for_adc(a ? adc_slave_handle->Instance : current_adc_handle->Instance);
+            if (lut == NULL) {
+                continue;
+            }
+            for (uint16_t i = a; i < S10077_NUM_PIXELS; i += 2) {
+                adc_buffer[i] = lut[adc_buffer[i] & (S10077_DSP_LUT_SIZE - 1)];
+            }
+        }
+    }
+
+    S10077_SensorState* state = &sensor_state[current_sensor_id];
+
+    frame_output_suppressed = false;
+    frame_hdr_merged = false;
+    if (frame_hdr_phase == HDR_PHASE_SHORT) {
+        memcpy(hdr_short_frame[current_sensor_id], adc_buffer, sizeof(adc_buffer));
+        state->hdr_short_valid = true;
+        frame_output_suppressed = true;
+        return;
+    }
+    if (frame_hdr_phase == HDR_PHASE_LONG && state->hdr_short_valid) {
+        const uint16_t* short_frame = hdr_short_frame[current_sensor_id];
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            if (adc_buffer[i] >= S10077_HDR_KNEE) {
+                adc_buffer[i] = (uint16_t)((short_frame[i] * state->hdr_ratio_q8 + 128) >> 8);
+            }
+        }
+        state->hdr_short_valid = false;
+        frame_hdr_merged = true;
+    }
+
+    histogram_bins = state->hist_bins;
+    if (histogram_bins == 0 && state->output_mode == S10077_OUTPUT_HISTOGRAM) {
+        histogram_bins = S10077_HIST_BINS;
+    }
+    if (histogram_bins != 0) {
+        uint8_t bin_shift = 12;
+        for (uint16_t b = histogram_bins; b > 1; b >>= 1) {
+            bin_shift--;
+        }
+        S10077_DSP_Histogram(adc_buffer, S10077_NUM_PIXELS, bin_shift, histogram, histogram_bins);
+    }
+
+    if (noise_active && current_sensor_id == noise_sensor_id && noise_frames < noise_target_frames) {
+        S10077_DSP_AccumulateMoments(adc_buffer, S10077_NUM_PIXELS, noise_sum, noise_sum_sq);
+        noise_frames++;
+    }
+
+    if (state->ema_alpha_q16 != 0) {
+        S10077_DSP_TemporalFilter(adc_buffer, S10077_NUM_PIXELS, ema_state[current_sensor_id],
+                                  state->ema_alpha_q16, !state->ema_primed);
+        state->ema_primed = true;
+    }
+
+    frame_resampled = false;
+    if (state->resample_enabled && state->wl_calibrated) {
+        S10077_DSP_Resample(adc_buffer, S10077_NUM_PIXELS, wl_positions[current_sensor_id],
+                            resample_buffer, S10077_NUM_PIXELS);
+        memcpy(adc_buffer, resample_buffer, sizeof(adc_buffer));
+        frame_resampled = true;
+    }
+
+    derivative_valid = false;
+    if (state->sg_window != 0 &&
+        S10077_DSP_SavitzkyGolay(adc_buffer, sg_output, S10077_NUM_PIXELS, state->sg_window, state->sg_derivative))
+    {
+        if (state->sg_derivative == 0) {
+            for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+                adc_buffer[i] = (sg_output[i] < 0) ? 0 : (uint16_t)sg_output[i];
+            }
+        } else {
+            derivative_valid = true;
+        }
+    }
+}
+
+/**
+ * @brief  Makes a frame popped from the frame store the current frame, as if it had just been acquired.
+ */
+static void load_stored_frame_context(const S10077_FrameInfo* info)
+{
+    current_sensor_id = info->sensor_id;
+    current_adc_handle = sensor_configs[info->sensor_id].adc_handle;
+    current_tim_handle = sensor_configs[info->sensor_id].trig_tim_handle;
+    frame_seq = info->seq;
+    frame_timestamp_us = info->timestamp_us;
+    frame_hdr_phase = (HdrPhase)info->exposure;
+    frame_start = FRAME_START_FIRMWARE;
+    frame_replayed = true;
+    frame_processed = false;
+    data_ready_flag = true;
+}
+
+/**
+ * @brief  Compares the current frame with the last one sent by S10077_OUTPUT_CHANGE.
+ * @retval true if the frame is to be sent; it then becomes the new reference.
+ */
+static bool change_detected(void)
+{
+    S10077_SensorState* state = &sensor_state[current_sensor_id];
+    uint16_t* reference = change_reference[current_sensor_id];
+    uint16_t start = state->change_roi_start;
+    uint16_t length = state->change_roi_length;
+    bool send;
+
+    if (length == 0 || start >= S10077_NUM_PIXELS) {
+        start = 0;
+        length = S10077_NUM_PIXELS;
+    } else if (length > S10077_NUM_PIXELS - start) {
+        length = S10077_NUM_PIXELS - start;
+    }
+
+    frame_change = 0;
+    if (state->change_reference_valid) {
+        uint32_t sad;
+        uint16_t max_diff;
+        S10077_DSP_FrameDifference(&adc_buffer[start], &reference[start], length, &sad, &max_diff);
+        frame_change = (state->change_metric == S10077_CHANGE_MAX) ? max_diff : sad;
+    }
+    state->change_frames_since_sent++;
+
+    send = !state->change_reference_valid || frame_change > state->change_threshold ||
+           (state->change_heartbeat != 0 && state->change_frames_since_sent >= state->change_heartbeat);
+    if (send) {
+        memcpy(reference, adc_buffer, sizeof(adc_buffer));
+        state->change_reference_valid = true;
+        state->change_frames_since_sent = 0;
+    }
+    return send;
+}
+
+/**
+ * @brief  Processes the current frame and transmits it according to the sensor's output mode.
+ */
+static void output_frame(void)
+{
+    int n;
+
+    process_frame();
+    if (frame_output_suppressed) {
+        return;
+    }
+
+    // Frames of a sensor under noise characterization are consumed by the accumulator, also in pull mode
+    if (noise_active && current_sensor_id == noise_sensor_id) {
+        if (noise_frames >= noise_target_frames) {
+            send_noise_vector("NOISE_MEAN", false);
+            send_noise_vector("NOISE_VAR", true);
+            noise_active = false;
+            return_noise_sums();
+        }
+        return;
+    }
+
+    if (!frame_replayed) {
+        LatestFrameInfo* latest = &latest_info[current_sensor_id];
+        latest->valid = false;   // Not sent while being overwritten
+        memcpy(latest_frame[current_sensor_id], adc_buffer, sizeof(adc_buffer));
+        latest->seq = frame_seq;
+        latest->timestamp_us = frame_timestamp_us;
+        latest->resampled = frame_resampled;
+        latest->hdr_merged = frame_hdr_merged;
+        latest->resolution = adc_resolution;
+        latest->oversampling = oversampling;
+        latest->valid = true;
+        if (pull_mode) {
+            return;
+        }
+    }
+
+    S10077_SensorState* state = &sensor_state[current_sensor_id];
+    bool summary = true;
+
+    switch (state->output_mode) {
+    case S10077_OUTPUT_PEAKS:
+        n = encode_peaks();
+        break;
+    case S10077_OUTPUT_EDGES:
+        n = encode_edges();
+        break;
+    case S10077_OUTPUT_STATS:
+        n = encode_stats();
+        break;
+    case S10077_OUTPUT_HISTOGRAM:
+        n = encode_histogram();
+        break;
+    case S10077_OUTPUT_CHANGE:
+        if (!change_detected()) {
+            return;
+        }
+        frame_change_valid = true;
+        n = encode_raw_frame();
+        frame_change_valid = false;
+        summary = false;
+        break;
+    case S10077_OUTPUT_RAW:
+    default:
+        n = derivative_valid ? encode_derivative() : encode_raw_frame();
+        summary = false;
+        break;
+    }
+
+    // Stored frames were captured to be delivered; live frames follow the sensor's backpressure policy
+    if (!tx_open_entry(current_sensor_id, frame_replayed ? S10077_BACKPRESSURE_BLOCK : state->backpressure) ||
+        !tx_append(n)) {
+        return;
+    }
+
+    // Dual-rate output: the first and then every Nth summary record is followed by the full frame
+    if (summary && state->full_frame_interval != 0) {
+        if ((state->summary_count % state->full_frame_interval) == 0) {
+            n = encode_raw_frame();
+            if (!tx_append(n)) {
+                return;
+            }
+        }
+        state->summary_count++;
+    }
+
+    if (histogram_bins != 0 && state->output_mode != S10077_OUTPUT_HISTOGRAM) {
+        n = encode_histogram();
+        if (!tx_append(n)) {
+            return;
+        }
+    }
+    tx_commit();
+}
+
+/**
+ * @brief  Takes a frame of the sensor armed for pre-trigger capture into the frame store
+ * and advances the capture when a trigger has fired.
+ */
+static void capture_pretrigger_frame(void)
+{
+    S10077_FrameInfo info = { frame_seq, frame_timestamp_us, current_sensor_id, (uint8_t)frame_hdr_phase };
+
+    if (pretrig_state == PRETRIG_ARMED)
+    {
+        if (pretrig_request) {
+            pretrig_time_us = pretrig_request_us;
+            pretrig_source = pretrig_request_source;
+            pretrig_state = PRETRIG_POST;
+        } else if (pretrig_level != 0) {
+            S10077_FrameStats stats;
+            S10077_DSP_ComputeStats(adc_buffer, S10077_NUM_PIXELS, S10077_SATURATION_LEVEL, &stats);
+            if (stats.max >= pretrig_level) {
+                pretrig_time_us = frame_timestamp_us;
+                pretrig_source = S10077_TRIGGER_LEVEL;
+                pretrig_state = PRETRIG_POST;
+            }
+        }
+
+        if (pretrig_state == PRETRIG_ARMED) {
+            // Keep only the newest pre_frames frames
+            if (pretrig_pre_frames == 0) {
+                return;
+            }
+            if (S10077_FrameStore_Count() >= pretrig_pre_frames) {
+                S10077_FrameStore_DropOldest();
+            }
+            S10077_FrameStore_Push(adc_buffer, &info, true);
+            return;
+        }
+        pretrig_post_count = 0;
+    }
+
+    if (pretrig_state == PRETRIG_POST)
+    {
+        S10077_FrameStore_Push(adc_buffer, &info, false);
+        pretrig_post_count++;
+        if (pretrig_post_count >= pretrig_post_frames) {
+            static const char* const source_names[] = { "HOST", "GPIO", "LEVEL" };
+            int n = snprintf(tx_buffer, sizeof(tx_buffer), "TRIGGER,SENSOR_%u,%s,%lu,%u,%u,END\r\n",
+                             pretrig_sensor_id, source_names[pretrig_source], (unsigned long)pretrig_time_us,
+                             (uint16_t)(S10077_FrameStore_Count() - pretrig_post_count), pretrig_post_count);
+            send_record(n);
+            pretrig_state = PRETRIG_DUMP;
+        }
+    }
+    // In PRETRIG_DUMP the store is frozen and live frames are discarded
+}
+
+/**
+ * @brief  Sends the oldest frame of a frozen pre-trigger window and re-arms the capture once it is empty.
+ */
+static void send_pretrigger_frame(void)
+{
+    S10077_FrameInfo info;
+
+    if (S10077_FrameStore_Pop(adc_buffer, &info)) {
+        load_stored_frame_context(&info);
+        output_frame();
+    }
+    if (S10077_FrameStore_Count() == 0) {
+        pretrig_request = false;
+        pretrig_state = PRETRIG_ARMED;
+    }
+}
+
+/**
+ * @brief  Starts sending the oldest L lines in the frame store as a tile once that many have been collected.
+ */
+static void start_tile_if_complete(void)
+{
+    if (linescan_sending || S10077_FrameStore_Count() < linescan_lines) {
+        return;
+    }
+    int n = snprintf(tx_buffer, sizeof(tx_buffer), "TILE_BEGIN,SENSOR_%u,%lu,%u,%u,%s,END\r\n",
+                     linescan_sensor_id, (unsigned long)linescan_tile_seq, linescan_lines,
+                     S10077_NUM_PIXELS, linescan_compress ? "MED" : "RAW");
+    send_record(n);
+    linescan_send_line = 0;
+    linescan_sending = true;
+}
+
+/**
+ * @brief  Sends the next line of the tile being sent under the line-scan sensor's backpressure policy, and closes
+ * the tile after its last line. With compression, the line is sent as its MED prediction residuals against the
+ * line before it, which stays in the store until then.
+ */
+static void send_tile_line(void)
+{
+    S10077_FrameInfo info;
+
+    if (linescan_compress) {
+        if (linescan_send_line != 0) {
+            S10077_FrameStore_Pop(resample_buffer, &info);
+        }
+        S10077_FrameStore_Peek(adc_buffer, &info);
+        S10077_DSP_PredictMED(adc_buffer, (linescan_send_line != 0) ? resample_buffer : NULL, sg_output,
+                              S10077_NUM_PIXELS);
+        derivative_valid = false;
+    } else {
+        S10077_FrameStore_Pop(adc_buffer, &info);
+    }
+
+    int n = snprintf(tx_buffer, sizeof(tx_buffer), "TILE_LINE,%u,%lu,%lu,", linescan_send_line,
+                     (unsigned long)info.seq, (unsigned long)info.timestamp_us);
+    for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+        if (linescan_compress) {
+            n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%d,", sg_output[i]);
+        } else {
+            n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "%u,", adc_buffer[i]);
+        }
+    }
+    n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+    if (tx_open_entry(linescan_sensor_id, sensor_state[linescan_sensor_id].backpressure) && tx_append(n)) {
+        tx_commit();
+    }
+
+    if (++linescan_send_line < linescan_lines) {
+        return;
+    }
+    if (linescan_compress) {
+        S10077_FrameStore_DropOldest();
+    }
+    n = snprintf(tx_buffer, sizeof(tx_buffer), "TILE_END,SENSOR_%u,%lu,END\r\n",
+                 linescan_sensor_id, (unsigned long)linescan_tile_seq);
+    send_record(n);
+    linescan_tile_seq++;
+    linescan_sending = false;
+    start_tile_if_complete();
+}
+
+/**
+ * @brief  Adds the processed frame of the line-scan sensor to the tiles in the frame store. A line that finds
+ * the store full (tiles not sent fast enough) is dropped and counted.
+ */
+static void capture_line(void)
+{
+    process_frame();
+    if (frame_output_suppressed) {
+        return;
+    }
+
+    S10077_FrameInfo info = { frame_seq, frame_timestamp_us, current_sensor_id, (uint8_t)frame_hdr_phase };
+    if (!S10077_FrameStore_Push(adc_buffer, &info, false)) {
+        sensor_state[current_sensor_id].dropped_frames++;
+    }
+    start_tile_if_complete();
+}
+
+/**
+ * @brief  Configures the ADC chain of a sensor and arms its DMA, leaving only the ST pulse to be sent.
+ * @retval Integration time of this acquisition in microseconds.
+ */
+static uint32_t prepare_acquisition(uint8_t sensor_id)
+{
+    current_sensor_id = sensor_id;
+    const S10077_SensorConfig* config = &sensor_configs[sensor_id];
+    S10077_SensorState* state = &sensor_state[sensor_id];
+    // Store the handle of the ADC we are about to use. This is crucial for the callback.
+    current_adc_handle = config->adc_handle;
+    current_tim_handle = config->trig_tim_handle;
+    frame_seq = sensor_state[sensor_id].frame_count++;
+    frame_replayed = false;
+    frame_processed = false;
+    data_ready_flag = false;
+
+    uint32_t integration_us = state->integration_us;
+    frame_hdr_phase = HDR_PHASE_NONE;
+    if (state->hdr_short_us != 0) {
+        frame_hdr_phase = state->hdr_long_next ? HDR_PHASE_LONG : HDR_PHASE_SHORT;
+        integration_us = state->hdr_long_next ? state->hdr_long_us : state->hdr_short_us;
+        state->hdr_long_next = !state->hdr_long_next;
+    }
+
+    // --- Dynamically Reconfigure ADC ---
+	// ADC should be stopped (ADEN=0) by HAL_ADC_Stop_DMA in the callback
+
+	// Step 1: Configure ADC Channel (Modify SQRx register)
+	ADC_ChannelConfTypeDef sConfig = {0};
+	sConfig.Channel = config->adc_channel;
+	sConfig.Rank = 1;
+	sConfig.SamplingTime = adc_timing.sample_time; // Chosen together with the pixel clock
+	if (HAL_ADC_ConfigChannel(current_adc_handle, &sConfig) != HAL_OK)
+	{
+		Error_Handler();
+	}
+	if (adc_slave_handle != NULL && HAL_ADC_ConfigChannel(adc_slave_handle, &sConfig) != HAL_OK)
+	{
+		Error_Handler();
+	}
+
+	// Step 2: Configure ADC Trigger Source (Modify EXTSEL register)
+#if defined(STM32F446xx)
+	MODIFY_REG(current_adc_handle->Instance->CR2, ADC_CR2_EXTSEL, config->adc_extsel_trigger);
+#elif defined(STM32H723xx)
+	MODIFY_REG(current_adc_handle->Instance->CFGR, ADC_CFGR_EXTSEL, config->adc_extsel_trigger);
+#else
+	#error "Unsupported MCU type for dynamic EXTSEL switching."
+#endif
+    if (adc_slave_handle == NULL)
+    {
+        apply_sample_phase(current_tim_handle, state->sample_phase_ns);
+    }
+
+    // Step 3: Prepare the correct ADC and DMA to listen for triggers from its pre-configured timer.
+    // This is the ONLY activation command needed for the acquisition chain.
+    if (adc_slave_handle != NULL)
+    {
+        // Interleaved: every other TRG edge triggers a pair, one word per pair; the first edge must count
+        __HAL_TIM_SET_COUNTER(current_tim_handle, 1);
+        if (HAL_ADCEx_MultiModeStart_DMA(current_adc_handle, (uint32_t*)adc_buffer, S10077_NUM_PIXELS / 2) != HAL_OK)
+        {
+            Error_Handler();
+        }
+        return integration_us;
+    }
+    if (oversampling > 1)
+    {
+        // One scan of 'oversampling' ranks on the same channel per TRG edge, averaged block by block
+        for (uint8_t rank = 2; rank <= oversampling; rank++)
+        {
+            sConfig.Rank = rank;
+            if (HAL_ADC_ConfigChannel(current_adc_handle, &sConfig) != HAL_OK)
+            {
+                Error_Handler();
+            }
+        }
+        os_pixels_done = 0;
+        if (HAL_ADC_Start_DMA(current_adc_handle, (uint32_t*)os_dma_buffer, 2 * OS_BLOCK_PIXELS * oversampling) != HAL_OK)
+        {
+            Error_Handler();
+        }
+        return integration_us;
+    }
+	if (HAL_ADC_Start_DMA(current_adc_handle, (uint32_t*)adc_buffer, S10077_NUM_PIXELS) != HAL_OK)
+	{
+		Error_Handler();
+	}
+    return integration_us;
+}
+
+/**
+ * @brief  Releases ST of the integrating sensor and timestamps the frame.
+ */
+static void end_integration(void)
+{
+    const S10077_SensorConfig* config = &sensor_configs[current_sensor_id];
+    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_RESET);
+    frame_timestamp_us = get_timestamp_us();
+    integrating = false;
+    if (trigger_timer_handle != NULL) {
+        __HAL_TIM_DISABLE_IT(trigger_timer_handle, TIM_IT_CC2);
+    }
+}
+
+/**
+ * @brief  Programs the next trigger timer CH2 compare of the integration, at most TRIGGER_TIMER_MAX_STEP ticks
+ * after the previous one. A compare time already passed while programming is raised by software at once.
+ * @param  from: Counter value the step is measured from.
+ */
+static void schedule_integration_step(uint16_t from)
+{
+    TIM_HandleTypeDef* htim = trigger_timer_handle;
+    uint32_t step = (integration_ticks_left < TRIGGER_TIMER_MAX_STEP) ? integration_ticks_left : TRIGGER_TIMER_MAX_STEP;
+
+    integration_ticks_left -= step;
+    __HAL_TIM_SET_COMPARE(htim, TIM_CHANNEL_2, (uint16_t)(from + step));
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_CC2);
+    __HAL_TIM_ENABLE_IT(htim, TIM_IT_CC2);
+    if ((uint16_t)(__HAL_TIM_GET_COUNTER(htim) - from) >= step && !__HAL_TIM_GET_FLAG(htim, TIM_FLAG_CC2)) {
+        htim->Instance->EGR = TIM_EGR_CC2G;
+    }
+}
+
+/**
+ * @brief  Asserts ST of an armed acquisition. Called from the start event interrupt.
+ * @retval false if no acquisition was armed.
+ */
+static bool start_armed_acquisition(void)
+{
+    if (!acq_armed) {
+        return false;
+    }
+    acq_armed = false;
+
+    const S10077_SensorConfig* config = &sensor_configs[current_sensor_id];
+    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_SET);
+    integration_start_cycles = DWT->CYCCNT;
+    integrating = true;
+    if (trigger_timer_handle != NULL) {
+        integration_start_tick = (uint16_t)__HAL_TIM_GET_COUNTER(trigger_timer_handle);
+        integration_ticks_left = integration_ticks;
+        schedule_integration_step(integration_start_tick);
+    }
+    return true;
+}
+
+/**
+ * @brief  Counts a trigger edge and starts the armed acquisition with it.
+ * @retval false if the edge was missed (nothing armed, or the frame clock runs).
+ */
+static bool external_trigger_start(void)
+{
+    ext_trigger_count++;
+    if (frame_clock_handle != NULL || !start_armed_acquisition()) {
+        ext_missed_count++;
+        return false;
+    }
+    frame_start = FRAME_START_EXTERNAL;
+    frame_event_count = ext_trigger_count;
+    return true;
+}
+
+/**
+ * @brief  Requests the pre-trigger capture with the time the trigger happened.
+ */
+static void pretrigger_request(S10077_TriggerSource source, uint32_t time_us)
+{
+    if (pretrig_state != PRETRIG_ARMED || pretrig_request) {
+        return;
+    }
+    pretrig_request_us = time_us;
+    pretrig_request_source = source;
+    pretrig_request = true;
+}
+
+//================================================================================
+// Public Function Implementations
+//================================================================================
+
+void S10077_System_Init(const S10077_SensorConfig* configs, uint8_t num_sensors, TIM_HandleTypeDef* htim_clk, UART_HandleTypeDef* huart)
+{
+    sensor_configs = configs;
+    configured_sensor_count = (num_sensors > S10077_MAX_SENSORS) ? S10077_MAX_SENSORS : num_sensors;
+    clk_tim_handle = htim_clk;
+    uart_handle = huart;
+    pixel_clock_hz = timer_clock_hz(clk_tim_handle) / (__HAL_TIM_GET_AUTORELOAD(htim_clk) + 1);
+
+    // Per-sensor tables for the configured sensors only; the frame store gets the rest of the pool
+    uint8_t n = configured_sensor_count;
+    ram_pool_used = 0;
+    latest_frame = pool_alloc(n * sizeof(latest_frame[0]));
+    hdr_short_frame = pool_alloc(n * sizeof(hdr_short_frame[0]));
+    change_reference = pool_alloc(n * sizeof(change_reference[0]));
+    ema_state = pool_alloc(n * sizeof(ema_state[0]));
+    wl_positions = pool_alloc(n * sizeof(wl_positions[0]));
+    for (uint8_t t = 0; t < S10077_MAX_LUTS; t++) {
+        lut_adc[t] = NULL;
+        lut_table[t] = NULL;
+    }
+
+    for (uint8_t i = 0; i < S10077_MAX_SENSORS; i++) {
+        sensor_state[i].output_mode = S10077_OUTPUT_RAW;
+        sensor_state[i].peak_threshold = S10077_PEAK_THRESHOLD;
+        sensor_state[i].edge_level = 0;
+        sensor_state[i].edge_hysteresis = S10077_EDGE_HYSTERESIS;
+        sensor_state[i].full_frame_interval = 0;
+        sensor_state[i].ema_alpha_q16 = 0;
+        sensor_state[i].ema_primed = false;
+        sensor_state[i].sg_window = 0;
+        sensor_state[i].sg_derivative = 0;
+        sensor_state[i].frame_count = 0;
+        sensor_state[i].integration_us = S10077_INTEGRATION_TIME_MS * 1000u;
+        sensor_state[i].backpressure = S10077_BACKPRESSURE_BLOCK;
+        sensor_state[i].decimation = 1;
+        sensor_state[i].dropped_frames = 0;
+        sensor_state[i].period_us = 0;
+        sensor_state[i].sample_phase_ns = (i < configured_sensor_count) ? configs[i].sample_phase_ns : 0;
+        sensor_state[i].resample_enabled = false;
+        sensor_state[i].wl_calibrated = false;
+    }
+    // Interpolation tables for the default grid, so resampling works without S10077_SetWavelengthGrid()
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        build_wavelength_table(i);
+    }
+
+    S10077_FrameStore_Reset(S10077_STORE_16BIT);
+    HAL_UART_Receive_IT(uart_handle, &rx_byte, 1);
+
+    // Enable the DWT cycle counter for the processing benchmarks
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    if (HAL_TIM_PWM_Start(clk_tim_handle, TIM_CHANNEL_1) != HAL_OK)
+    {
+        Error_Handler();
+    }
+}
+
+void S10077_StartAcquisition(uint8_t sensor_id)
+{
+    if (sensor_id >= configured_sensor_count) {
+        return; // Invalid sensor ID
+    }
+
+    const S10077_SensorConfig* config = &sensor_configs[sensor_id];
+    uint32_t integration_us = prepare_acquisition(sensor_id);
+    frame_start = FRAME_START_FIRMWARE;
+
+    // Step 2: Send the ST pulse to the specific sensor to start its data readout.
+    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_SET);
+    delay_us(integration_us);
+    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_RESET);
+    frame_timestamp_us = get_timestamp_us();
+}
+
+void S10077_ArmAcquisition(uint8_t sensor_id)
+{
+    if (sensor_id >= configured_sensor_count || acq_armed || integrating) {
+        return;
+    }
+
+    uint32_t integration_us = prepare_acquisition(sensor_id);
+    integration_cycles = integration_us * (SystemCoreClock / 1000000u);
+    integration_ticks = integration_us * (TRIGGER_TIMER_HZ / 1000000u);
+    acq_armed = true;
+}
+
+void S10077_CancelArmedAcquisition(void)
+{
+    if (!acq_armed) {
+        return;
+    }
+    acq_armed = false;
+    stop_adc();
+}
+
+void S10077_ExternalTriggerISR(void)
+{
+    uint32_t trigger_cycles = DWT->CYCCNT;
+
+    if (external_trigger_start()) {
+        frame_trigger_latency_ns = (integration_start_cycles - trigger_cycles) * 1000u / (SystemCoreClock / 1000000u);
+    }
+}
+
+bool S10077_SetTriggerTimer(TIM_HandleTypeDef* htim)
+{
+    if (htim == NULL || htim->Instance == NULL || acquisition_busy()) {
+        return false;
+    }
+    uint32_t clock_hz = timer_clock_hz(htim);
+    if (clock_hz % TRIGGER_TIMER_HZ != 0) {
+        return false;
+    }
+
+    if (trigger_timer_handle != NULL) {
+        HAL_TIM_IC_Stop_IT(trigger_timer_handle, TIM_CHANNEL_1);
+        trigger_timer_handle = NULL;
+    }
+    __HAL_TIM_SET_PRESCALER(htim, clock_hz / TRIGGER_TIMER_HZ - 1);
+    __HAL_TIM_SET_AUTORELOAD(htim, 0xFFFF);
+    htim->Instance->EGR = TIM_EGR_UG; // Load the prescaler now
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE | TIM_FLAG_CC1 | TIM_FLAG_CC2);
+    if (HAL_TIM_IC_Start_IT(htim, TIM_CHANNEL_1) != HAL_OK) {
+        return false;
+    }
+    trigger_timer_handle = htim;
+    return true;
+}
+
+void S10077_GetExternalTriggerCounts(uint32_t* triggers, uint32_t* missed)
+{
+    *triggers = ext_trigger_count;
+    *missed = ext_missed_count;
+}
+
+bool S10077_StartFrameClock(TIM_HandleTypeDef* htim, uint32_t period_us)
+{
+    if (period_us < 2 || htim->Instance == NULL) {
+        return false;
+    }
+    S10077_StopFrameClock();
+
+    __HAL_TIM_SET_AUTORELOAD(htim, period_us - 1);
+    __HAL_TIM_SET_COUNTER(htim, 0);
+    __HAL_TIM_CLEAR_FLAG(htim, TIM_FLAG_UPDATE);
+    clock_tick_count = 0;
+    clock_missed_count = 0;
+    frame_clock_handle = htim;
+    if (HAL_TIM_Base_Start_IT(htim) != HAL_OK) {
+        frame_clock_handle = NULL;
+        return false;
+    }
+    return true;
+}
+
+void S10077_StopFrameClock(void)
+{
+    if (frame_clock_handle == NULL) {
+        return;
+    }
+    HAL_TIM_Base_Stop_IT(frame_clock_handle);
+    frame_clock_handle = NULL;
+}
+
+void S10077_GetFrameClockCounts(uint32_t* ticks, uint32_t* missed)
+{
+    *ticks = clock_tick_count;
+    *missed = clock_missed_count;
+}
+
+void S10077_SetFramePeriod(uint8_t sensor_id, uint32_t period_us, uint8_t priority)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    S10077_SensorState* state = &sensor_state[sensor_id];
+
+    state->period_us = period_us;
+    state->priority = priority;
+    state->next_release_us = get_timestamp_us();
+    state->sched_frames = 0;
+    state->sched_skipped = 0;
+    state->sched_lateness_sum_us = 0;
+    state->sched_lateness_max_us = 0;
+}
+
+int8_t S10077_ScheduleNext(void)
+{
+    uint32_t now = get_timestamp_us();
+    int8_t next = -1;
+    int32_t next_slack = 0;
+
+    // Earliest deadline first among the released frames; the higher priority wins a tie
+    for (uint8_t i = 0; i < configured_sensor_count; i++)
+    {
+        const S10077_SensorState* state = &sensor_state[i];
+        if (state->period_us == 0 || (int32_t)(now - state->next_release_us) < 0) {
+            continue;
+        }
+        int32_t slack = (int32_t)(state->next_release_us + state->period_us - now);
+        if (next < 0 || slack < next_slack ||
+            (slack == next_slack && state->priority > sensor_state[next].priority)) {
+            next = (int8_t)i;
+            next_slack = slack;
+        }
+    }
+    if (next < 0) {
+        return -1;
+    }
+
+    S10077_SensorState* state = &sensor_state[next];
+    uint32_t lateness = now - state->next_release_us;
+    state->sched_frames++;
+    state->sched_lateness_sum_us += lateness;
+    if (lateness > state->sched_lateness_max_us) {
+        state->sched_lateness_max_us = lateness;
+    }
+
+    // Release the next frame one period later, skipping periods that have already passed entirely
+    state->next_release_us += state->period_us;
+    while ((int32_t)(now - state->next_release_us) >= (int32_t)state->period_us) {
+        state->next_release_us += state->period_us;
+        state->sched_skipped++;
+    }
+    return next;
+}
+
+void S10077_SendScheduleReport(void)
+{
+    uint32_t now = get_timestamp_us();
+    uint32_t elapsed_us = now - sched_report_start_us;
+
+    for (uint8_t i = 0; i < configured_sensor_count; i++)
+    {
+        S10077_SensorState* state = &sensor_state[i];
+        if (state->period_us == 0) {
+            continue;
+        }
+        uint32_t rate_mhz = (elapsed_us != 0) ? (uint32_t)((uint64_t)state->sched_frames * 1000000000u / elapsed_us) : 0;
+        uint32_t mean_lateness_us = (state->sched_frames != 0) ? state->sched_lateness_sum_us / state->sched_frames : 0;
+
+        int n = snprintf(tx_buffer, sizeof(tx_buffer), "SCHED,SENSOR_%u,%lu,%lu,%lu.%03lu,%lu,%lu,%lu,END\r\n", i,
+                         (unsigned long)state->period_us, (unsigned long)state->sched_frames,
+                         (unsigned long)(rate_mhz / 1000), (unsigned long)(rate_mhz % 1000),
+                         (unsigned long)mean_lateness_us, (unsigned long)state->sched_lateness_max_us,
+                         (unsigned long)state->sched_skipped);
+        send_record(n);
+
+        state->sched_frames = 0;
+        state->sched_skipped = 0;
+        state->sched_lateness_sum_us = 0;
+        state->sched_lateness_max_us = 0;
+    }
+    sched_report_start_us = now;
+}
+
+bool S10077_SetPixelClock(uint32_t clock_hz)
+{
+    uint32_t timer_hz = timer_clock_hz(clk_tim_handle);
+    AdcTiming timing;
+
+    if (clock_hz == 0) {
+        return false;
+    }
+    uint32_t period = (timer_hz + clock_hz / 2) / clock_hz;
+    if (period < 2 || period > 0x10000) {
+        return false;   // Beyond the 16-bit timer at prescaler 0
+    }
+    uint32_t actual_hz = timer_hz / period;
+    if (actual_hz > S10077_PIXEL_CLOCK_MAX_HZ ||
+        !select_adc_timing(actual_hz, adc_resolution, adc_slave_handle != NULL, oversampling, &timing)) {
+        return false;
+    }
+    // The clock must not change under a frame being integrated or read out
+    if (acquisition_busy()) {
+        return false;
+    }
+
+    __HAL_TIM_SET_AUTORELOAD(clk_tim_handle, period - 1);
+    __HAL_TIM_SET_COMPARE(clk_tim_handle, TIM_CHANNEL_1, period / 2);
+    HAL_TIM_GenerateEvent(clk_tim_handle, TIM_EVENTSOURCE_UPDATE);  // Load the preloaded compare value now
+    clk_tim_handle->Init.Period = period - 1;
+
+    apply_adc_timing(&timing);
+    pixel_clock_hz = actual_hz;
+    return true;
+}
+
+uint32_t S10077_GetPixelClock(void)
+{
+    return pixel_clock_hz;
+}
+
+bool S10077_SetResolution(S10077_Resolution resolution)
+{
+    AdcTiming timing;
+    uint32_t res_bits;
+
+    switch (resolution) {
+    case S10077_RESOLUTION_10BIT: res_bits = ADC_RESOLUTION_10B; break;
+    case S10077_RESOLUTION_8BIT:  res_bits = ADC_RESOLUTION_8B;  break;
+    case S10077_RESOLUTION_12BIT: res_bits = ADC_RESOLUTION_12B; break;
+    default: return false;
+    }
+    if (!select_adc_timing(pixel_clock_hz, resolution, adc_slave_handle != NULL, oversampling, &timing)) {
+        return false;
+    }
+    if (acquisition_busy()) {
+        return false;
+    }
+
+    // The shorter conversion leaves more of the pixel period for sampling
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        ADC_HandleTypeDef* hadc = sensor_configs[i].adc_handle;
+        MODIFY_REG(hadc->Instance->CR1, ADC_CR1_RES, res_bits);
+        hadc->Init.Resolution = res_bits;
+    }
+    if (adc_slave_handle != NULL) {
+        MODIFY_REG(adc_slave_handle->Instance->CR1, ADC_CR1_RES, res_bits);
+        adc_slave_handle->Init.Resolution = res_bits;
+    }
+    apply_adc_timing(&timing);
+    adc_resolution = resolution;
+    return true;
+}
+
+bool S10077_SetOversampling(uint8_t factor)
+{
+    AdcTiming timing;
+    bool enable = (factor > 1);
+
+    if (factor == 0 || factor > S10077_MAX_OVERSAMPLING || (enable && adc_slave_handle != NULL)) {
+        return false;
+    }
+    if (!select_adc_timing(pixel_clock_hz, adc_resolution, false, factor, &timing)) {
+        return false;
+    }
+    if (acquisition_busy()) {
+        return false;
+    }
+
+    // Scan 'factor' ranks per trigger; the DMA wraps around the block buffer and keeps its requests going
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        ADC_HandleTypeDef* hadc = sensor_configs[i].adc_handle;
+        MODIFY_REG(hadc->Instance->CR1, ADC_CR1_SCAN, enable ? ADC_CR1_SCAN : 0);
+        MODIFY_REG(hadc->Instance->SQR1, ADC_SQR1_L, ADC_SQR1(factor));
+        MODIFY_REG(hadc->Instance->CR2, ADC_CR2_DDS, enable ? ADC_CR2_DDS : 0);
+        hadc->Init.ScanConvMode = enable ? ENABLE : DISABLE;
+        hadc->Init.NbrOfConversion = factor;
+        hadc->Init.DMAContinuousRequests = enable ? ENABLE : DISABLE;
 
-//================================================================================
-// Public Function Implementations
-//================================================================================
+        DMA_HandleTypeDef* hdma = hadc->DMA_Handle;
+        if (hdma->Init.Mode != (enable ? DMA_CIRCULAR : DMA_NORMAL)) {
+            hdma->Init.Mode = enable ? DMA_CIRCULAR : DMA_NORMAL;
+            if (HAL_DMA_Init(hdma) != HAL_OK) {
+                Error_Handler();
+            }
+        }
+    }
+    apply_adc_timing(&timing);
+    oversampling = factor;
+    return true;
+}
 
-void S10077_System_Init(const S10077_SensorConfig* configs, uint8_t num_sensors, TIM_HandleTypeDef* htim_clk, UART_HandleTypeDef* huart)
+bool S10077_SetInterleaved(ADC_HandleTypeDef* hadc_slave)
 {
-    sensor_configs = configs;
-    configured_sensor_count = num_sensors;
-    clk_tim_handle = htim_clk;
-    uart_handle = huart;
+    ADC_HandleTypeDef* master = sensor_configs[0].adc_handle;
+    ADC_MultiModeTypeDef multimode = {0};
+    TIM_SlaveConfigTypeDef slave_config = {0};
+    AdcTiming timing;
+    bool enable = (hadc_slave != NULL);
 
-    if (HAL_TIM_PWM_Start(clk_tim_handle, TIM_CHANNEL_1) != HAL_OK)
-    {
+    if (enable == (adc_slave_handle != NULL) || (enable && oversampling > 1) || acquisition_busy()) {
+        return false;
+    }
+    if (enable) {
+        // ADC1 is the master of the pair; all sensors must be wired to it
+        if (master->Instance != ADC1 || hadc_slave->Instance != ADC2) {
+            return false;
+        }
+        // The pairs are timed by counting TRG edges, which leaves no room for a sample phase
+        for (uint8_t i = 0; i < configured_sensor_count; i++) {
+            if (sensor_configs[i].adc_handle != master || sensor_state[i].sample_phase_ns != 0) {
+                return false;
+            }
+        }
+    }
+    if (!select_adc_timing(pixel_clock_hz, adc_resolution, enable, 1, &timing)) {
+        return false;
+    }
+
+    multimode.Mode = enable ? ADC_DUALMODE_INTERL : ADC_MODE_INDEPENDENT;
+    multimode.DMAAccessMode = enable ? ADC_DMAACCESSMODE_2 : ADC_DMAACCESSMODE_DISABLED;
+    multimode.TwoSamplingDelay = timing.delay;
+    if (HAL_ADCEx_MultiModeConfigChannel(master, &multimode) != HAL_OK) {
+        return false;
+    }
+
+    // Pairs are read from the common data register as one word: ADC1 in the low, ADC2 in the high half-word
+    DMA_HandleTypeDef* hdma = master->DMA_Handle;
+    hdma->Init.PeriphDataAlignment = enable ? DMA_PDATAALIGN_WORD : DMA_PDATAALIGN_HALFWORD;
+    hdma->Init.MemDataAlignment = enable ? DMA_MDATAALIGN_WORD : DMA_MDATAALIGN_HALFWORD;
+    if (HAL_DMA_Init(hdma) != HAL_OK) {
         Error_Handler();
     }
+
+    // Trigger timers: interleaved pairs start on every other TRG edge, counted in external clock mode
+    slave_config.SlaveMode = enable ? TIM_SLAVEMODE_EXTERNAL1 : TIM_SLAVEMODE_RESET;
+    slave_config.InputTrigger = TIM_TS_TI1FP1;
+    slave_config.TriggerPolarity = TIM_INPUTCHANNELPOLARITY_FALLING;
+    slave_config.TriggerFilter = 0;
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        TIM_HandleTypeDef* htim = sensor_configs[i].trig_tim_handle;
+        bool shared = false;
+        for (uint8_t j = 0; j < i; j++) {
+            shared |= (sensor_configs[j].trig_tim_handle == htim);
+        }
+        if (shared) {
+            continue;
+        }
+        if (enable) {
+            apply_sample_phase(htim, 0);   // Undo a one-pulse setup left by an earlier phase
+        }
+        if (HAL_TIM_SlaveConfigSynchro(htim, &slave_config) != HAL_OK) {
+            Error_Handler();
+        }
+        if (enable) {
+            trig_tim_period[i] = __HAL_TIM_GET_AUTORELOAD(htim);
+            __HAL_TIM_SET_AUTORELOAD(htim, 1);
+            __HAL_TIM_ENABLE(htim);
+        } else {
+            __HAL_TIM_DISABLE(htim);
+            __HAL_TIM_SET_AUTORELOAD(htim, trig_tim_period[i]);
+        }
+    }
+
+    if (enable) {
+        MODIFY_REG(hadc_slave->Instance->CR1, ADC_CR1_RES, master->Init.Resolution);
+        hadc_slave->Init.Resolution = master->Init.Resolution;
+        __HAL_ADC_ENABLE(hadc_slave);
+    } else {
+        __HAL_ADC_DISABLE(adc_slave_handle);
+    }
+    adc_slave_handle = hadc_slave;
+    apply_adc_timing(&timing);
+    return true;
 }
 
-void S10077_StartAcquisition(uint8_t sensor_id)
+bool S10077_SetSamplePhase(uint8_t sensor_id, uint32_t phase_ns)
 {
-    if (sensor_id >= configured_sensor_count) {
-        return; // Invalid sensor ID
+    if (sensor_id >= S10077_MAX_SENSORS || phase_ns > max_sample_phase_ns()) {
+        return false;
+    }
+    if (phase_ns != 0 && adc_slave_handle != NULL) {
+        return false;
     }
+    sensor_state[sensor_id].sample_phase_ns = phase_ns;
+    return true;
+}
 
-    current_sensor_id = sensor_id;
-    const S10077_SensorConfig* config = &sensor_configs[sensor_id];
-    // Store the handle of the ADC we are about to use. This is crucial for the callback.
-    current_adc_handle = config->adc_handle;
-    current_tim_handle = config->trig_tim_handle;
-    data_ready_flag = false;
+uint32_t S10077_GetSamplePhase(uint8_t sensor_id)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return 0;
+    }
+    return sensor_state[sensor_id].sample_phase_ns;
+}
 
-    // --- Dynamically Reconfigure ADC ---
-	// ADC should be stopped (ADEN=0) by HAL_ADC_Stop_DMA in the callback
+bool S10077_CalibrateSamplePhase(uint8_t sensor_id, uint8_t steps, uint16_t frames_per_step)
+{
+    uint32_t max_ns = max_sample_phase_ns();
+    uint32_t best_ns = 0;
+    float best_score = -1.0f;
 
-	// Step 1: Configure ADC Channel (Modify SQRx register)
-	ADC_ChannelConfTypeDef sConfig = {0};
-	sConfig.Channel = config->adc_channel;
-	sConfig.Rank = 1;
-	sConfig.SamplingTime = ADC_SAMPLETIME_28CYCLES; // Make sure this sampling time is sufficient
-	if (HAL_ADC_ConfigChannel(current_adc_handle, &sConfig) != HAL_OK)
-	{
-		Error_Handler();
-	}
+    // The moment sums of the noise characterization are borrowed for each step
+    if (sensor_id >= configured_sensor_count || steps < 2 || frames_per_step < 2 ||
+        adc_slave_handle != NULL || noise_active || sensor_state[sensor_id].hdr_short_us != 0 ||
+        acquisition_busy() || frame_clock_handle != NULL || !borrow_noise_sums()) {
+        return false;
+    }
+    S10077_SensorState* state = &sensor_state[sensor_id];
+    // Calibration frames are never sent, so they must not leave gaps in the sensor's SEQ
+    uint32_t frame_count = state->frame_count;
 
-	// Step 2: Configure ADC Trigger Source (Modify EXTSEL register)
-#if defined(STM32F446xx)
-	MODIFY_REG(current_adc_handle->Instance->CR2, ADC_CR2_EXTSEL, config->adc_extsel_trigger);
-#elif defined(STM32H723xx)
-	MODIFY_REG(current_adc_handle->Instance->CFGR, ADC_CFGR_EXTSEL, config->adc_extsel_trigger);
-#else
-	#error "Unsupported MCU type for dynamic EXTSEL switching."
-#endif
+    for (uint8_t step = 0; step < steps; step++) {
+        uint32_t phase_ns = (uint32_t)((uint64_t)max_ns * step / (steps - 1));
+        state->sample_phase_ns = phase_ns;
+        memset(noise_sum, 0, S10077_NUM_PIXELS * sizeof(uint32_t));
+        memset(noise_sum_sq, 0, S10077_NUM_PIXELS * sizeof(uint64_t));
 
-    // Step 3: Prepare the correct ADC and DMA to listen for triggers from its pre-configured timer.
-    // This is the ONLY activation command needed for the acquisition chain.
-	if (HAL_ADC_Start_DMA(current_adc_handle, (uint32_t*)adc_buffer, S10077_NUM_PIXELS) != HAL_OK)
-	{
-		Error_Handler();
-	}
+        for (uint16_t f = 0; f < frames_per_step; f++) {
+            S10077_StartAcquisition(sensor_id);
+            while (!data_ready_flag) {
+                S10077_ProcessHostCommands();
+            }
+            S10077_DSP_AccumulateMoments(adc_buffer, S10077_NUM_PIXELS, noise_sum, noise_sum_sq);
+        }
+        data_ready_flag = false;
 
-    // Step 2: Send the ST pulse to the specific sensor to start its data readout.
-    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_SET);
-    HAL_Delay(S10077_INTEGRATION_TIME_MS);
-    HAL_GPIO_WritePin(config->st_port, config->st_pin, GPIO_PIN_RESET);
+        // Frame SNR: mean signal over RMS temporal noise, compared squared
+        uint64_t signal_q8 = 0;
+        uint64_t variance_q8 = 0;
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            uint32_t mean;
+            uint32_t variance;
+            S10077_DSP_MomentsToQ8(noise_sum[i], noise_sum_sq[i], frames_per_step, &mean, &variance);
+            signal_q8 += mean;
+            variance_q8 += variance;
+        }
+        float signal = (float)signal_q8;
+        float score = (variance_q8 != 0) ? signal * signal / (float)variance_q8 : signal * signal;
+        if (score > best_score) {
+            best_score = score;
+            best_ns = phase_ns;
+        }
+
+        int n = snprintf(tx_buffer, sizeof(tx_buffer), "PHASE_SCAN,SENSOR_%u,%lu,", sensor_id, (unsigned long)phase_ns);
+        n = append_q8(n, (uint32_t)(signal_q8 / S10077_NUM_PIXELS));
+        n = append_q8(n, (uint32_t)(variance_q8 / S10077_NUM_PIXELS));
+        n += snprintf(tx_buffer + n, sizeof(tx_buffer) - n, "END\r\n");
+        send_record(n);
+    }
+
+    state->sample_phase_ns = best_ns;
+    state->frame_count = frame_count;
+    return_noise_sums();
+    int n = snprintf(tx_buffer, sizeof(tx_buffer), "PHASE,SENSOR_%u,%lu,END\r\n", sensor_id, (unsigned long)best_ns);
+    send_record(n);
+    return true;
+}
+
+void S10077_SetIntegrationTime(uint8_t sensor_id, uint32_t integration_us)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].integration_us = integration_us;
+}
+
+bool S10077_SetHDR(uint8_t sensor_id, uint32_t short_us, uint32_t long_us)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return false;
+    }
+    S10077_SensorState* state = &sensor_state[sensor_id];
+
+    if (short_us != 0 && (long_us < short_us || long_us > short_us * S10077_HDR_MAX_RATIO)) {
+        return false;
+    }
+    state->hdr_short_us = short_us;
+    state->hdr_long_us = long_us;
+    state->hdr_ratio_q8 = (short_us != 0) ? (uint32_t)(((uint64_t)long_us << 8) / short_us) : 256;
+    state->hdr_long_next = false;
+    state->hdr_short_valid = false;
+    return true;
 }
 
 bool S10077_IsDataReady(void)
 {
+    if (trigger_timer_handle == NULL && integrating &&
+        (DWT->CYCCNT - integration_start_cycles) >= integration_cycles) {
+        end_integration();
+    }
     return data_ready_flag;
 }
 
 void S10077_PrintDataViaUART(void)
 {
 	if (!data_ready_flag) return;
-	static char buf[S10077_NUM_PIXELS * 6 + 100];
-    int n = 0;
 
-    n += snprintf(buf + n, sizeof(buf) - n, "BEGIN,SENSOR_%u,", current_sensor_id);
-    for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
-    	if (n >= (sizeof(buf) - 10)) {
-    	            break;
-		}
-		n += snprintf(buf + n, sizeof(buf) - n, "%u,", adc_buffer[i]);
+    if (linescan_active && current_sensor_id == linescan_sensor_id) {
+        capture_line();
+    } else if (pretrig_state != PRETRIG_OFF && current_sensor_id == pretrig_sensor_id) {
+        capture_pretrigger_frame();
+    } else {
+        output_frame();
     }
-    if (n < (sizeof(buf) - 6)) {
-             n += snprintf(buf + n, sizeof(buf) - n, "END\r\n");
-	}
 
-    HAL_UART_Transmit(uart_handle, (uint8_t*)buf, n, HAL_MAX_DELAY);
+    if (pretrig_state == PRETRIG_DUMP) {
+        send_pretrigger_frame();
+    }
+    if (linescan_active && linescan_sending) {
+        send_tile_line();
+    }
+}
+
+uint16_t S10077_CaptureBurst(uint8_t sensor_id, uint16_t num_frames, S10077_StoreFormat format)
+{
+    uint16_t captured = 0;
+
+    if (sensor_id >= configured_sensor_count || acquisition_busy() || noise_active) {
+        return 0;
+    }
+    pretrig_state = PRETRIG_OFF;
+    linescan_active = false;
+    format = store_format_for(format);
+    S10077_FrameStore_Reset(format);
+
+    while (captured < num_frames)
+    {
+        S10077_StartAcquisition(sensor_id);
+        while (!data_ready_flag) {
+            S10077_ProcessHostCommands();
+        }
+
+        S10077_FrameInfo info = { frame_seq, frame_timestamp_us, sensor_id, (uint8_t)frame_hdr_phase };
+        if (!S10077_FrameStore_Push(adc_buffer, &info, false)) {
+            break;
+        }
+        captured++;
+    }
+    // The frames go out through S10077_SendStoredFrames(), not S10077_PrintDataViaUART()
+    data_ready_flag = false;
+    return captured;
+}
+
+uint16_t S10077_SendStoredFrames(void)
+{
+    S10077_FrameInfo info;
+    uint16_t sent = 0;
+
+    while (S10077_FrameStore_Pop(adc_buffer, &info))
+    {
+        load_stored_frame_context(&info);
+        output_frame();
+        sent++;
+    }
+    return sent;
+}
+
+bool S10077_ArmPreTrigger(uint8_t sensor_id, uint16_t pre_frames, uint16_t post_frames, S10077_StoreFormat format)
+{
+    if (sensor_id >= configured_sensor_count || post_frames == 0 || noise_active) {
+        return false;
+    }
+    pretrig_state = PRETRIG_OFF;
+    linescan_active = false;
+    format = store_format_for(format);
+    S10077_FrameStore_Reset(format);
+    if ((uint32_t)pre_frames + post_frames > S10077_FrameStore_Capacity()) {
+        return false;
+    }
+
+    pretrig_sensor_id = sensor_id;
+    pretrig_format = format;
+    pretrig_pre_frames = pre_frames;
+    pretrig_post_frames = post_frames;
+    pretrig_request = false;
+    pretrig_state = PRETRIG_ARMED;
+    return true;
+}
+
+void S10077_DisarmPreTrigger(void)
+{
+    pretrig_state = PRETRIG_OFF;
+    pretrig_request = false;
+    S10077_FrameStore_Reset(pretrig_format);
+}
+
+void S10077_SetPreTriggerLevel(uint16_t level)
+{
+    pretrig_level = level;
+}
+
+void S10077_Trigger(S10077_TriggerSource source)
+{
+    pretrigger_request(source, get_timestamp_us());
+}
+
+bool S10077_SetLineScan(uint8_t sensor_id, uint16_t lines, S10077_StoreFormat format, bool compress)
+{
+    if (sensor_id >= configured_sensor_count || lines == 0 || noise_active) {
+        return false;
+    }
+    linescan_active = false;
+    pretrig_state = PRETRIG_OFF;
+    S10077_FrameStore_Reset(store_format_for(format));
+    if (lines > S10077_FrameStore_Capacity()) {
+        return false;
+    }
+
+    linescan_sensor_id = sensor_id;
+    linescan_lines = lines;
+    linescan_compress = compress;
+    linescan_tile_seq = 0;
+    linescan_sending = false;
+    linescan_active = true;
+    return true;
+}
+
+void S10077_StopLineScan(void)
+{
+    if (!linescan_active) {
+        return;
+    }
+    linescan_active = false;
+    S10077_FrameStore_Reset(S10077_STORE_16BIT);
+}
+
+void S10077_SetPullMode(bool enable)
+{
+    pull_mode = enable;
+}
+
+void S10077_ProcessHostCommands(void)
+{
+    unsigned int sensor_id;
+    int n;
+
+    // Armed and timer-ended integrations run on interrupts; only a polled integration end must not be delayed
+    if (!rx_line_ready || (integrating && trigger_timer_handle == NULL)) {
+        return;
+    }
+
+    if (sscanf(rx_line, "GET %u", &sensor_id) == 1) {
+        if (sensor_id < configured_sensor_count && latest_info[sensor_id].valid) {
+            n = encode_latest_frame((uint8_t)sensor_id);
+        } else {
+            n = snprintf(tx_buffer, sizeof(tx_buffer), "NODATA,SENSOR_%u,END\r\n", sensor_id);
+        }
+        send_record(n);
+    } else if (strcmp(rx_line, "TRIGGER") == 0) {
+        S10077_Trigger(S10077_TRIGGER_HOST);
+    }
+    rx_line_ready = false;
+}
+
+void S10077_SetBackpressure(uint8_t sensor_id, S10077_Backpressure policy, uint8_t decimation)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].backpressure = policy;
+    sensor_state[sensor_id].decimation = (decimation == 0) ? 1 : decimation;
+    sensor_state[sensor_id].decimate_skipped = 0;
+}
+
+uint32_t S10077_GetDroppedFrames(uint8_t sensor_id)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return 0;
+    }
+    return sensor_state[sensor_id].dropped_frames;
+}
+
+void S10077_SetOutputMode(uint8_t sensor_id, S10077_OutputMode mode)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].output_mode = mode;
+    sensor_state[sensor_id].change_reference_valid = false;
+}
+
+void S10077_SetPeakThreshold(uint8_t sensor_id, uint16_t threshold)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].peak_threshold = threshold;
+}
+
+void S10077_SetEdgeDetection(uint8_t sensor_id, uint16_t level, uint16_t hysteresis)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].edge_level = level;
+    sensor_state[sensor_id].edge_hysteresis = hysteresis;
+}
+
+void S10077_SetFullFrameInterval(uint8_t sensor_id, uint16_t interval)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].full_frame_interval = interval;
+    sensor_state[sensor_id].summary_count = 0;
+}
+
+void S10077_SetChangeDetection(uint8_t sensor_id, S10077_ChangeMetric metric, uint32_t threshold, uint16_t heartbeat_frames)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].change_metric = metric;
+    sensor_state[sensor_id].change_threshold = threshold;
+    sensor_state[sensor_id].change_heartbeat = heartbeat_frames;
+    sensor_state[sensor_id].change_reference_valid = false;
+}
+
+void S10077_SetChangeROI(uint8_t sensor_id, uint16_t first_pixel, uint16_t num_pixels)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].change_roi_start = first_pixel;
+    sensor_state[sensor_id].change_roi_length = num_pixels;
+    sensor_state[sensor_id].change_reference_valid = false;
+}
+
+void S10077_SetHistogram(uint8_t sensor_id, uint16_t num_bins)
+{
+    if (sensor_id >= S10077_MAX_SENSORS || num_bins == 1 || num_bins > S10077_DSP_MAX_HIST_BINS ||
+        (num_bins & (num_bins - 1)) != 0) {
+        return;
+    }
+    sensor_state[sensor_id].hist_bins = num_bins;
+}
+
+bool S10077_SetLinearizationLUT(ADC_HandleTypeDef* hadc, const uint16_t* table)
+{
+    int8_t slot = -1;
+
+    for (uint8_t t = 0; t < S10077_MAX_LUTS; t++) {
+        if (lut_adc[t] == hadc->Instance) {
+            slot = t;
+            break;
+        }
+        if (slot < 0 && lut_adc[t] == NULL) {
+            slot = t;
+        }
+    }
+    if (slot < 0) {
+        return false;
+    }
+
+    if (table == NULL) {
+        if (lut_adc[slot] == hadc->Instance) {
+            lut_adc[slot] = NULL;
+        }
+        return true;
+    }
+
+    if (lut_table[slot] == NULL) {
+        // The first table takes its RAM from the frame store
+        if (frame_store_in_use()) {
+            return false;
+        }
+        lut_table[slot] = pool_alloc(LUT_BYTES);
+    }
+    lut_adc[slot] = NULL;   // Not applied while being overwritten
+    memcpy(lut_table[slot], table, LUT_BYTES);
+    lut_adc[slot] = hadc->Instance;
+    return true;
+}
+
+void S10077_SetTemporalFilter(uint8_t sensor_id, uint16_t time_constant_frames)
+{
+    if (sensor_id >= S10077_MAX_SENSORS) {
+        return;
+    }
+    sensor_state[sensor_id].ema_alpha_q16 = (time_constant_frames > 1) ? (65536u / time_constant_frames) : 0;
+    sensor_state[sensor_id].ema_primed = false;
+}
+
+bool S10077_SetSavitzkyGolay(uint8_t sensor_id, uint8_t window, uint8_t derivative)
+{
+    if (sensor_id >= S10077_MAX_SENSORS || derivative > S10077_DSP_SG_MAX_DERIV) {
+        return false;
+    }
+    // Window 0 disables the stage; anything else must match one of the odd kernels
+    if (window != 0 && (window < 5 || window > S10077_DSP_SG_MAX_WINDOW || (window & 1) == 0)) {
+        return false;
+    }
+    sensor_state[sensor_id].sg_window = window;
+    sensor_state[sensor_id].sg_derivative = derivative;
+    return true;
+}
+
+void S10077_BenchmarkSavitzkyGolay(void)
+{
+    for (uint8_t derivative = 0; derivative <= S10077_DSP_SG_MAX_DERIV; derivative++) {
+        for (uint8_t window = 5; window <= S10077_DSP_SG_MAX_WINDOW; window += 2) {
+            uint32_t start = DWT->CYCCNT;
+            S10077_DSP_SavitzkyGolay(adc_buffer, sg_output, S10077_NUM_PIXELS, window, derivative);
+            uint32_t cycles = DWT->CYCCNT - start;
+
+            int n = snprintf(tx_buffer, sizeof(tx_buffer), "SG_BENCH,%u,%u,%lu,END\r\n",
+                             window, derivative, (unsigned long)cycles);
+            send_record(n);
+        }
+    }
+    derivative_valid = false;
+}
+
+void S10077_SetWavelengthGrid(float start_nm, float end_nm)
+{
+    if (!(end_nm > start_nm)) {
+        return;
+    }
+    wl_grid_start_nm = start_nm;
+    wl_grid_end_nm = end_nm;
+    for (uint8_t i = 0; i < configured_sensor_count; i++) {
+        build_wavelength_table(i);
+    }
+}
+
+bool S10077_SetWavelengthResampling(uint8_t sensor_id, bool enable)
+{
+    if (sensor_id >= S10077_MAX_SENSORS || (enable && !sensor_state[sensor_id].wl_calibrated)) {
+        return false;
+    }
+    sensor_state[sensor_id].resample_enabled = enable;
+    return true;
+}
+
+void S10077_StartNoiseAccumulation(uint8_t sensor_id, uint16_t num_frames)
+{
+    if (sensor_id >= configured_sensor_count || num_frames < 2 || noise_active || !borrow_noise_sums()) {
+        return;
+    }
+    noise_sensor_id = sensor_id;
+    noise_target_frames = num_frames;
+    noise_frames = 0;
+    noise_active = true;
+}
+
+bool S10077_IsNoiseAccumulationActive(void)
+{
+    return noise_active;
 }
 
 //================================================================================
 // HAL Callback Function Override
 //================================================================================
 
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc)
+{
+  // Only the circular oversampling transfer is split into blocks
+  if(current_adc_handle != NULL && hadc->Instance == current_adc_handle->Instance && oversampling > 1)
+  {
+    average_oversampled_block(os_dma_buffer);
+  }
+}
+
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc)
 {
   // Check if this callback is from the ADC we expect
   if(current_adc_handle != NULL && hadc->Instance == current_adc_handle->Instance)
   {
+    if (oversampling > 1) {
+        // Second block; the circular DMA keeps running until the frame is complete
+        average_oversampled_block(&os_dma_buffer[OS_BLOCK_PIXELS * oversampling]);
+        if (os_pixels_done < S10077_NUM_PIXELS) {
+            return;
+        }
+    }
     // Stop ADC. This will set ADEN=0 (H7) or ADON=0 (F4),
     // allowing safe reconfiguration in the next StartAcquisition().
     // This is necessary for H7 compatibility.
-    HAL_ADC_Stop_DMA(current_adc_handle);
+    stop_adc();
+    if (adc_resolution != S10077_RESOLUTION_12BIT) {
+        expand_to_12bit(adc_buffer, S10077_NUM_PIXELS);
+    }
 
     // In Reset Mode, we don't need to stop the TIM manually.
 
     data_ready_flag = true;
   }
 }
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart)
+{
+  if (uart_handle != NULL && huart->Instance == uart_handle->Instance)
+  {
+    tx_wire_pos += tx_chunk;
+    tx_start_next_chunk();
+  }
+}
+
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef* huart)
+{
+  if (uart_handle != NULL && huart->Instance == uart_handle->Instance)
+  {
+    // Bytes arriving while a command is still pending are dropped
+    if (!rx_line_ready) {
+      if (rx_byte == '\r' || rx_byte == '\n') {
+        if (rx_length != 0) {
+          rx_line[rx_length] = '\0';
+          rx_length = 0;
+          rx_line_ready = true;
+        }
+      } else if (rx_length < HOST_LINE_MAX - 1) {
+        rx_line[rx_length++] = (char)rx_byte;
+      }
+    }
+    HAL_UART_Receive_IT(huart, &rx_byte, 1);
+  }
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef* huart)
+{
+  // Overrun or framing error: reception stops, so restart it
+  if (uart_handle != NULL && huart->Instance == uart_handle->Instance)
+  {
+    HAL_UART_Receive_IT(huart, &rx_byte, 1);
+  }
+}
+
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef* htim)
+{
+  if (frame_clock_handle != NULL && htim->Instance == frame_clock_handle->Instance)
+  {
+    clock_tick_count++;
+    if (!start_armed_acquisition()) {
+      clock_missed_count++;
+      return;
+    }
+    frame_start = FRAME_START_CLOCK;
+    frame_event_count = clock_tick_count;
+    frame_missed_count = clock_missed_count;
+  }
+}
+
+void HAL_TIM_IC_CaptureCallback(TIM_HandleTypeDef* htim)
+{
+  if (trigger_timer_handle != NULL && htim->Instance == trigger_timer_handle->Instance &&
+      htim->Channel == HAL_TIM_ACTIVE_CHANNEL_1)
+  {
+    uint16_t edge_tick = (uint16_t)HAL_TIM_ReadCapturedValue(htim, TIM_CHANNEL_1);
+    if (external_trigger_start()) {
+      frame_trigger_latency_ns = (uint16_t)(integration_start_tick - edge_tick) * (1000000000u / TRIGGER_TIMER_HZ);
+    }
+    // Date the edge itself rather than this interrupt
+    uint16_t age_ticks = (uint16_t)__HAL_TIM_GET_COUNTER(htim) - edge_tick;
+    pretrigger_request(S10077_TRIGGER_GPIO, get_timestamp_us() - age_ticks / (TRIGGER_TIMER_HZ / 1000000u));
+  }
+}
+
+void HAL_TIM_OC_DelayElapsedCallback(TIM_HandleTypeDef* htim)
+{
+  if (trigger_timer_handle != NULL && htim->Instance == trigger_timer_handle->Instance &&
+      htim->Channel == HAL_TIM_ACTIVE_CHANNEL_2)
+  {
+    if (!integrating) {
+      __HAL_TIM_DISABLE_IT(htim, TIM_IT_CC2);
+    } else if (integration_ticks_left > 0) {
+      schedule_integration_step((uint16_t)__HAL_TIM_GET_COMPARE(htim, TIM_CHANNEL_2));
+    } else {
+      end_integration();
+    }
+  }
+}
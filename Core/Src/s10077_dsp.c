@@ -0,0 +1,518 @@
+#include "s10077_dsp.h"
+#include "main.h"
+#include <string.h>
+
+//================================================================================
+// Private Constants
+//================================================================================
+
+// Quadratic Savitzky-Golay kernels in Q15, indexed [derivative][(window - 5) / 2][tap]
+static const int16_t sg_kernels[S10077_DSP_SG_MAX_DERIV + 1][4][S10077_DSP_SG_MAX_WINDOW] = {
+    {   // Smoothing
+        { -2809, 11235, 15916, 11235, -2809 },
+        { -3121,  4681,  9362, 10923,  9362,  4681, -3121 },
+        { -2979,  1986,  5532,  7660,  8369,  7660,  5532,  1986, -2979 },
+        { -2750,   687,  3361,  5270,  6416,  6800,  6416,  5270,  3361,   687, -2750 },
+    },
+    {   // First derivative
+        { -6554, -3277,     0,  3277,  6554 },
+        { -3511, -2341, -1170,     0,  1170,  2341,  3511 },
+        { -2185, -1638, -1092,  -546,     0,   546,  1092,  1638,  2185 },
+        { -1489, -1192,  -894,  -596,  -298,     0,   298,   596,   894,  1192,  1489 },
+    },
+    {   // Second derivative
+        {  9362, -4681, -9362, -4681,  9362 },
+        {  3901,     0, -2341, -3120, -2341,     0,  3901 },
+        {  1986,   496,  -567, -1206, -1418, -1206,  -567,   496,  1986 },
+        {  1146,   458,   -76,  -458,  -687,  -766,  -687,  -458,   -76,   458,  1146 },
+    },
+};
+
+//================================================================================
+// Private Helper Functions
+//================================================================================
+
+/**
+ * @brief  Walks left from 'index' and returns the Q8 position where the signal falls to 'level'.
+ */
+static uint32_t find_left_crossing_q8(const uint16_t* frame, uint16_t index, uint16_t level)
+{
+    uint16_t j = index;
+    while (j > 0 && frame[j - 1] > level) {
+        j--;
+    }
+    if (j == 0) {
+        return 0;
+    }
+    // Crossing lies between j-1 (<= level) and j (> level)
+    uint32_t lo = frame[j - 1];
+    uint32_t hi = frame[j];
+    return ((uint32_t)(j - 1) << 8) + (((level - lo) << 8) / (hi - lo));
+}
+
+/**
+ * @brief  Walks right from 'index' and returns the Q8 position where the signal falls to 'level'.
+ */
+static uint32_t find_right_crossing_q8(const uint16_t* frame, uint16_t length, uint16_t index, uint16_t level)
+{
+    uint16_t k = index;
+    while (k < length - 1 && frame[k + 1] > level) {
+        k++;
+    }
+    if (k == length - 1) {
+        return (uint32_t)k << 8;
+    }
+    // Crossing lies between k (> level) and k+1 (<= level)
+    uint32_t hi = frame[k];
+    uint32_t lo = frame[k + 1];
+    return ((uint32_t)k << 8) + (((hi - level) << 8) / (hi - lo));
+}
+
+/**
+ * @brief  Rounds a Q15 accumulator to an integer and saturates it to int16.
+ */
+static inline int16_t q15_to_int16(int32_t acc)
+{
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > INT16_MAX) return INT16_MAX;
+    if (acc < INT16_MIN) return INT16_MIN;
+    return (int16_t)acc;
+}
+
+//================================================================================
+// Public Function Implementations
+//================================================================================
+
+uint8_t S10077_DSP_FindPeaks(const uint16_t* frame, uint16_t length, uint16_t threshold, S10077_Peak* peaks, uint8_t max_peaks)
+{
+    uint8_t count = 0;
+
+    if (length < 3 || max_peaks == 0) {
+        return 0;
+    }
+
+    for (uint16_t i = 1; i < length - 1; i++)
+    {
+        int32_t a = frame[i - 1];
+        int32_t b = frame[i];
+        int32_t c = frame[i + 1];
+
+        // Local maximum: strictly above the left neighbour, not below the right one (handles 2-pixel plateaus)
+        if (b < threshold || b <= a || b < c) {
+            continue;
+        }
+
+        // Parabolic vertex through (i-1, a), (i, b), (i+1, c): offset = 0.5 * (a - c) / (a - 2b + c)
+        // The denominator is always negative here because b > a and b >= c.
+        int32_t offset_q8 = ((a - c) * 128) / (a - 2 * b + c);
+
+        S10077_Peak peak;
+        peak.position_q8 = (uint32_t)((int32_t)((uint32_t)i << 8) + offset_q8);
+        peak.height = (uint16_t)b;
+
+        uint16_t half_level = (uint16_t)((b + threshold) / 2);
+        uint32_t left_q8 = find_left_crossing_q8(frame, i, half_level);
+        uint32_t right_q8 = find_right_crossing_q8(frame, length, i, half_level);
+        peak.width_q8 = right_q8 - left_q8;
+
+        if (count < max_peaks) {
+            peaks[count++] = peak;
+        } else {
+            // Table full: replace the weakest entry if this peak is stronger
+            uint8_t weakest = 0;
+            for (uint8_t p = 1; p < count; p++) {
+                if (peaks[p].height < peaks[weakest].height) {
+                    weakest = p;
+                }
+            }
+            if (peak.height > peaks[weakest].height) {
+                peaks[weakest] = peak;
+            }
+        }
+
+        // Skip the falling flank down to its first local minimum, so a neighbouring peak that merges
+        // with this one above half height is still reported
+        while (i < length - 2 && frame[i + 2] <= frame[i + 1]) {
+            i++;
+        }
+    }
+
+    // Replacement may have broken the ordering; restore it (the list is short)
+    for (uint8_t p = 1; p < count; p++) {
+        S10077_Peak key = peaks[p];
+        int8_t q = p - 1;
+        while (q >= 0 && peaks[q].position_q8 > key.position_q8) {
+            peaks[q + 1] = peaks[q];
+            q--;
+        }
+        peaks[q + 1] = key;
+    }
+
+    return count;
+}
+
+uint8_t S10077_DSP_FindEdges(const uint16_t* frame, uint16_t length, uint16_t level, uint16_t hysteresis, S10077_Edge* edges, uint8_t max_edges)
+{
+    uint8_t count = 0;
+
+    if (length < 2 || max_edges == 0) {
+        return 0;
+    }
+
+    if (level == 0) {
+        uint16_t min = frame[0];
+        uint16_t max = frame[0];
+        for (uint16_t i = 1; i < length; i++) {
+            if (frame[i] < min) min = frame[i];
+            if (frame[i] > max) max = frame[i];
+        }
+        level = (uint16_t)((min + max) / 2);
+    }
+
+    int32_t upper = (int32_t)level + hysteresis;
+    int32_t lower = (int32_t)level - hysteresis;
+    bool high = (frame[0] >= level);
+
+    for (uint16_t i = 1; i < length && count < max_edges; i++)
+    {
+        int32_t v = frame[i];
+        if ((!high && v < upper) || (high && v > lower)) {
+            continue;
+        }
+
+        // Confirmed transition: walk back to the last crossing of the level and interpolate there
+        uint16_t j = i;
+        if (!high) {
+            while (j > 1 && frame[j - 1] >= level) j--;
+        } else {
+            while (j > 1 && frame[j - 1] < level) j--;
+        }
+        int32_t before = frame[j - 1];
+        int32_t after = frame[j];
+        int32_t step = after - before;
+        int32_t fraction_q8 = (step != 0) ? ((((int32_t)level - before) << 8) / step) : 0;
+        if (fraction_q8 < 0) fraction_q8 = 0;
+        if (fraction_q8 > 255) fraction_q8 = 255;
+
+        edges[count].position_q8 = ((uint32_t)(j - 1) << 8) + (uint32_t)fraction_q8;
+        edges[count].polarity = high ? -1 : +1;
+        count++;
+        high = !high;
+    }
+
+    return count;
+}
+
+void S10077_DSP_ComputeStats(const uint16_t* frame, uint16_t length, uint16_t saturation_level, S10077_FrameStats* stats)
+{
+    uint32_t sum = 0;
+    uint16_t min = 0xFFFF;
+    uint16_t max = 0;
+    uint16_t argmax = 0;
+    uint16_t saturated = 0;
+    uint16_t i = 0;
+
+    if (length == 0) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    // Two pixels per word. USUB16 sets the per-halfword GE flags that SEL then uses as a lane mask.
+    const uint32_t* words = (const uint32_t*)frame;
+    uint32_t vmin = 0xFFFFFFFFu;
+    uint32_t vmax = 0;
+    uint32_t vargmax = 0;                         // Per-lane index of the first maximum
+    uint32_t vindex = 0x00010000u;                // Pixel indices of the current word (hi = i + 1, lo = i)
+    uint32_t vsat = 0;
+    uint32_t vsat_level = ((uint32_t)saturation_level << 16) | saturation_level;
+
+    for (; i + 1 < length; i += 2)
+    {
+        uint32_t w = *words++;
+        sum = __SMLAD(w, 0x00010001u, sum);       // sum += lo + hi (values < 32768, so signed is fine)
+        __USUB16(vmax, w);                        // GE where the lane keeps its maximum (ties keep the earlier index)
+        vmax = __SEL(vmax, w);
+        vargmax = __SEL(vargmax, vindex);
+        vindex = __UADD16(vindex, 0x00020002u);
+        __USUB16(w, vmin);
+        vmin = __SEL(vmin, w);
+        __USUB16(w, vsat_level);
+        vsat = __UADD16(vsat, __SEL(0x00010001u, 0));
+    }
+    min = (uint16_t)(((vmin & 0xFFFF) < (vmin >> 16)) ? (vmin & 0xFFFF) : (vmin >> 16));
+    if (i != 0) {
+        // Even pixels sit in the low lane; on a tie take whichever lane saw the maximum first
+        uint16_t max_lo = (uint16_t)(vmax & 0xFFFF);
+        uint16_t max_hi = (uint16_t)(vmax >> 16);
+        uint16_t arg_lo = (uint16_t)(vargmax & 0xFFFF);
+        uint16_t arg_hi = (uint16_t)(vargmax >> 16);
+        max = (max_lo >= max_hi) ? max_lo : max_hi;
+        argmax = (max_lo > max_hi || (max_lo == max_hi && arg_lo < arg_hi)) ? arg_lo : arg_hi;
+    }
+    saturated = (uint16_t)((vsat & 0xFFFF) + (vsat >> 16));
+#endif
+
+    // Scalar path (and odd tail on Cortex-M4)
+    for (; i < length; i++)
+    {
+        uint16_t v = frame[i];
+        sum += v;
+        if (v < min) min = v;
+        if (v > max) {
+            max = v;
+            argmax = i;
+        }
+        if (v >= saturation_level) saturated++;
+    }
+
+    stats->sum = sum;
+    stats->mean_q8 = (uint32_t)(((uint64_t)sum << 8) / length);
+    stats->min = min;
+    stats->max = max;
+    stats->argmax = argmax;
+    stats->saturated = saturated;
+}
+
+void S10077_DSP_FrameDifference(const uint16_t* a, const uint16_t* b, uint16_t length, uint32_t* sad, uint16_t* max_diff)
+{
+    uint32_t sum = 0;
+    uint16_t max = 0;
+    uint16_t i = 0;
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    // Align to a word boundary with one scalar pixel if needed
+    if (length != 0 && ((uintptr_t)a & 2u) != 0) {
+        max = (a[0] > b[0]) ? (a[0] - b[0]) : (b[0] - a[0]);
+        sum = max;
+        i = 1;
+    }
+
+    // |a - b| per halfword: both differences, with SEL picking the one that did not borrow
+    const uint32_t* wa = (const uint32_t*)&a[i];
+    const uint32_t* wb = (const uint32_t*)&b[i];
+    uint32_t vmax = 0;
+
+    for (; i + 1 < length; i += 2)
+    {
+        uint32_t x = *wa++;
+        uint32_t y = *wb++;
+        uint32_t d_xy = __USUB16(x, y);
+        uint32_t d_yx = __USUB16(y, x);           // GE set in the lanes where y >= x
+        uint32_t d = __SEL(d_yx, d_xy);
+        sum = __SMLAD(d, 0x00010001u, sum);       // sum += lo + hi
+        __USUB16(d, vmax);
+        vmax = __SEL(d, vmax);
+    }
+    uint16_t lane_max = (uint16_t)(((vmax & 0xFFFF) > (vmax >> 16)) ? (vmax & 0xFFFF) : (vmax >> 16));
+    if (lane_max > max) {
+        max = lane_max;
+    }
+#endif
+
+    // Scalar path (and odd tail on Cortex-M4)
+    for (; i < length; i++)
+    {
+        uint16_t d = (a[i] > b[i]) ? (a[i] - b[i]) : (b[i] - a[i]);
+        sum += d;
+        if (d > max) max = d;
+    }
+
+    *sad = sum;
+    *max_diff = max;
+}
+
+void S10077_DSP_AccumulateMoments(const uint16_t* frame, uint16_t length, uint32_t* sum, uint64_t* sum_sq)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint32_t v = frame[i];
+        sum[i] += v;
+        sum_sq[i] += v * v;
+    }
+}
+
+void S10077_DSP_MomentsToQ8(uint32_t sum, uint64_t sum_sq, uint32_t frames, uint32_t* mean_q8, uint32_t* variance_q8)
+{
+    if (frames == 0) {
+        *mean_q8 = 0;
+        *variance_q8 = 0;
+        return;
+    }
+
+    *mean_q8 = (uint32_t)(((uint64_t)sum << 8) / frames);
+
+    if (frames < 2) {
+        *variance_q8 = 0;
+        return;
+    }
+
+    // var = (N * sum_sq - sum^2) / (N * (N - 1)), split into quotient and remainder so the Q8 shift cannot overflow
+    uint64_t spread = (uint64_t)frames * sum_sq - (uint64_t)sum * sum;
+    uint64_t divisor = (uint64_t)frames * (frames - 1);
+    uint64_t quotient = spread / divisor;
+    uint64_t remainder = spread % divisor;
+    // Variances from 2^24 up (HDR-merged frames reach 15 bits) do not fit in Q8
+    if (quotient >= (1u << 24)) {
+        *variance_q8 = UINT32_MAX;
+        return;
+    }
+    *variance_q8 = (uint32_t)((quotient << 8) + ((remainder << 8) / divisor));
+}
+
+void S10077_DSP_TemporalFilter(uint16_t* frame, uint16_t length, uint32_t* state_q16, uint32_t alpha_q16, bool prime)
+{
+    if (prime) {
+        for (uint16_t i = 0; i < length; i++) {
+            state_q16[i] = (uint32_t)frame[i] << 16;
+        }
+        return;
+    }
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        int32_t y = (int32_t)state_q16[i];
+        int32_t diff = ((int32_t)frame[i] << 16) - y;
+        y += (int32_t)(((int64_t)diff * alpha_q16) >> 16);
+        state_q16[i] = (uint32_t)y;
+        frame[i] = (uint16_t)(((uint32_t)y + 0x8000u) >> 16);
+    }
+}
+
+bool S10077_DSP_SavitzkyGolay(const uint16_t* frame, int16_t* out, uint16_t length, uint8_t window, uint8_t derivative)
+{
+    if (derivative > S10077_DSP_SG_MAX_DERIV || window < 5 || window > S10077_DSP_SG_MAX_WINDOW ||
+        (window & 1) == 0 || length < window) {
+        return false;
+    }
+
+    const int16_t* kernel = sg_kernels[derivative][(window - 5) / 2];
+    uint16_t half = window / 2;
+
+    // Edges: clamp the sample index into the frame
+    for (uint16_t i = 0; i < length; i++)
+    {
+        if (i == half) {
+            i = length - half;   // Interior is handled below
+        }
+        int32_t acc = 0;
+        for (uint8_t k = 0; k < window; k++) {
+            int32_t j = (int32_t)i - half + k;
+            if (j < 0) j = 0;
+            if (j >= length) j = length - 1;
+            acc += kernel[k] * (int32_t)frame[j];
+        }
+        out[i] = q15_to_int16(acc);
+    }
+
+#if defined(__ARM_FEATURE_DSP) && (__ARM_FEATURE_DSP == 1)
+    // Pack coefficient pairs once; the last (odd) tap is applied separately
+    uint32_t coeff_pairs[S10077_DSP_SG_MAX_WINDOW / 2];
+    uint8_t num_pairs = window / 2;
+    for (uint8_t p = 0; p < num_pairs; p++) {
+        coeff_pairs[p] = ((uint32_t)(uint16_t)kernel[2 * p]) | ((uint32_t)(uint16_t)kernel[2 * p + 1] << 16);
+    }
+    int32_t last_tap = kernel[window - 1];
+
+    for (uint16_t i = half; i < length - half; i++)
+    {
+        const uint16_t* x = &frame[i - half];
+        int32_t acc = 0;
+        for (uint8_t p = 0; p < num_pairs; p++) {
+            acc = (int32_t)__SMLAD(__UNALIGNED_UINT32_READ(&x[2 * p]), coeff_pairs[p], (uint32_t)acc);
+        }
+        acc += last_tap * (int32_t)x[window - 1];
+        out[i] = q15_to_int16(acc);
+    }
+#else
+    for (uint16_t i = half; i < length - half; i++)
+    {
+        const uint16_t* x = &frame[i - half];
+        int32_t acc = 0;
+        for (uint8_t k = 0; k < window; k++) {
+            acc += kernel[k] * (int32_t)x[k];
+        }
+        out[i] = q15_to_int16(acc);
+    }
+#endif
+
+    return true;
+}
+
+void S10077_DSP_Resample(const uint16_t* in, uint16_t in_length, const uint32_t* positions_q16, uint16_t* out, uint16_t out_length)
+{
+    for (uint16_t k = 0; k < out_length; k++)
+    {
+        uint32_t position = positions_q16[k];
+        uint32_t i = position >> 16;
+        if (position == S10077_DSP_POSITION_INVALID || i >= in_length) {
+            out[k] = 0;
+            continue;
+        }
+        if (i == in_length - 1u) {
+            out[k] = in[i];
+            continue;
+        }
+        int32_t a = in[i];
+        int32_t b = in[i + 1];
+        int32_t fraction = (int32_t)(position & 0xFFFF);
+        out[k] = (uint16_t)(a + (((b - a) * fraction + 0x8000) >> 16));
+    }
+}
+
+void S10077_DSP_ApplyLUT(uint16_t* frame, uint16_t length, const uint16_t* lut)
+{
+    uint16_t i = 0;
+
+    // Unrolled by four; the mask only guards the table bounds and costs no extra load
+    for (; i + 3 < length; i += 4)
+    {
+        frame[i]     = lut[frame[i]     & (S10077_DSP_LUT_SIZE - 1)];
+        frame[i + 1] = lut[frame[i + 1] & (S10077_DSP_LUT_SIZE - 1)];
+        frame[i + 2] = lut[frame[i + 2] & (S10077_DSP_LUT_SIZE - 1)];
+        frame[i + 3] = lut[frame[i + 3] & (S10077_DSP_LUT_SIZE - 1)];
+    }
+    for (; i < length; i++) {
+        frame[i] = lut[frame[i] & (S10077_DSP_LUT_SIZE - 1)];
+    }
+}
+
+void S10077_DSP_Histogram(const uint16_t* frame, uint16_t length, uint8_t bin_shift, uint16_t* bins, uint16_t num_bins)
+{
+    memset(bins, 0, num_bins * sizeof(bins[0]));
+    if (num_bins == 0) {
+        return;
+    }
+
+    uint16_t last = num_bins - 1;
+    for (uint16_t i = 0; i < length; i++)
+    {
+        uint16_t bin = frame[i] >> bin_shift;
+        bins[(bin > last) ? last : bin]++;
+    }
+}
+
+void S10077_DSP_PredictMED(const uint16_t* line, const uint16_t* prev, int16_t* residual, uint16_t length)
+{
+    int32_t a = 0;   // Left
+    int32_t c = 0;   // Upper left
+
+    for (uint16_t i = 0; i < length; i++)
+    {
+        int32_t b = (prev != NULL) ? prev[i] : 0;
+        int32_t lo = (a < b) ? a : b;
+        int32_t hi = (a < b) ? b : a;
+        int32_t prediction;
+
+        if (c >= hi) {
+            prediction = lo;
+        } else if (c <= lo) {
+            prediction = hi;
+        } else {
+            prediction = a + b - c;
+        }
+        residual[i] = (int16_t)(line[i] - prediction);
+        a = line[i];
+        c = b;
+    }
+}
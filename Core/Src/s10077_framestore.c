@@ -0,0 +1,175 @@
+#include "s10077_framestore.h"
+#include <string.h>
+
+//================================================================================
+// Private Defines
+//================================================================================
+#define MAX_STORED_FRAMES   (S10077_RAM_POOL_BYTES / S10077_NUM_PIXELS) // Capacity of the largest arena in the densest (8-bit) format
+
+//================================================================================
+// Private Variables
+//================================================================================
+static uint8_t* store_arena = NULL;
+static uint32_t store_bytes = 0;
+static S10077_FrameInfo store_info[MAX_STORED_FRAMES];
+static S10077_StoreFormat store_format = S10077_STORE_16BIT;
+static uint32_t frame_bytes = S10077_NUM_PIXELS * 2;
+static uint16_t capacity = 0;
+static uint16_t head = 0;   // Index of the oldest frame
+static uint16_t count = 0;
+
+//================================================================================
+// Private Helper Functions
+//================================================================================
+
+/**
+ * @brief  Converts a 16-bit frame into the current storage format.
+ */
+static void pack_frame(const uint16_t* frame, uint8_t* dst)
+{
+    switch (store_format) {
+    case S10077_STORE_12BIT_PACKED:
+        for (int i = 0; i < S10077_NUM_PIXELS; i += 2) {
+            uint16_t a = frame[i] & 0x0FFF;
+            uint16_t b = frame[i + 1] & 0x0FFF;
+            *dst++ = (uint8_t)a;
+            *dst++ = (uint8_t)((a >> 8) | (b << 4));
+            *dst++ = (uint8_t)(b >> 4);
+        }
+        break;
+    case S10077_STORE_8BIT:
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            uint16_t v = (frame[i] > 0x0FFF) ? 0x0FFF : frame[i];
+            dst[i] = (uint8_t)(v >> 4);
+        }
+        break;
+    case S10077_STORE_16BIT:
+    default:
+        memcpy(dst, frame, S10077_NUM_PIXELS * sizeof(uint16_t));
+        break;
+    }
+}
+
+/**
+ * @brief  Converts a stored frame back into 16-bit pixels.
+ */
+static void unpack_frame(const uint8_t* src, uint16_t* frame)
+{
+    switch (store_format) {
+    case S10077_STORE_12BIT_PACKED:
+        for (int i = 0; i < S10077_NUM_PIXELS; i += 2) {
+            frame[i] = (uint16_t)(src[0] | ((src[1] & 0x0F) << 8));
+            frame[i + 1] = (uint16_t)((src[1] >> 4) | (src[2] << 4));
+            src += 3;
+        }
+        break;
+    case S10077_STORE_8BIT:
+        for (int i = 0; i < S10077_NUM_PIXELS; ++i) {
+            frame[i] = (uint16_t)((src[i] << 4) | (src[i] >> 4));  // Full scale stays 4095
+        }
+        break;
+    case S10077_STORE_16BIT:
+    default:
+        memcpy(frame, src, S10077_NUM_PIXELS * sizeof(uint16_t));
+        break;
+    }
+}
+
+//================================================================================
+// Public Function Implementations
+//================================================================================
+
+void S10077_FrameStore_Init(uint8_t* arena, uint32_t bytes)
+{
+    store_arena = arena;
+    store_bytes = bytes;
+    S10077_FrameStore_Reset(store_format);
+}
+
+void S10077_FrameStore_Reset(S10077_StoreFormat format)
+{
+    store_format = format;
+    switch (format) {
+    case S10077_STORE_12BIT_PACKED: frame_bytes = S10077_NUM_PIXELS / 2 * 3; break;
+    case S10077_STORE_8BIT:         frame_bytes = S10077_NUM_PIXELS;         break;
+    case S10077_STORE_16BIT:
+    default:                        frame_bytes = S10077_NUM_PIXELS * 2;     break;
+    }
+
+    capacity = (uint16_t)(store_bytes / frame_bytes);
+    head = 0;
+    count = 0;
+}
+
+uint8_t* S10077_FrameStore_Borrow(uint32_t bytes)
+{
+    head = 0;
+    count = 0;
+    capacity = 0;
+    return (bytes <= store_bytes) ? store_arena : NULL;
+}
+
+uint16_t S10077_FrameStore_Capacity(void)
+{
+    return capacity;
+}
+
+uint16_t S10077_FrameStore_Count(void)
+{
+    return count;
+}
+
+bool S10077_FrameStore_Push(const uint16_t* frame, const S10077_FrameInfo* info, bool overwrite)
+{
+    if (capacity == 0) {
+        return false;
+    }
+    if (count == capacity) {
+        if (!overwrite) {
+            return false;
+        }
+        head = (head + 1) % capacity;   // Drop the oldest
+        count--;
+    }
+
+    uint16_t slot = (head + count) % capacity;
+    pack_frame(frame, &store_arena[slot * frame_bytes]);
+    store_info[slot] = *info;
+    count++;
+    return true;
+}
+
+bool S10077_FrameStore_Pop(uint16_t* frame, S10077_FrameInfo* info)
+{
+    if (count == 0) {
+        return false;
+    }
+
+    unpack_frame(&store_arena[head * frame_bytes], frame);
+    *info = store_info[head];
+    head = (head + 1) % capacity;
+    count--;
+    return true;
+}
+
+bool S10077_FrameStore_Peek(uint16_t* frame, S10077_FrameInfo* info)
+{
+    if (count == 0) {
+        return false;
+    }
+
+    unpack_frame(&store_arena[head * frame_bytes], frame);
+    *info = store_info[head];
+    return true;
+}
+
+bool S10077_FrameStore_DropOldest(void)
+{
+    if (count == 0) {
+        return false;
+    }
+
+    head = (head + 1) % capacity;
+    count--;
+    return true;
+}
@@ -15,10 +15,14 @@ BEGIN_TOKEN = 'BEGIN,'
 END_TOKEN = 'END'
 SERIAL_ENCODING = 'utf-8'
 READ_TIMEOUT_S = 0.1
+TILE_HISTORY_LINES = 512   # Lines kept in the line-scan image view
+SUMMARY_TAGS = ('STATS', 'PEAKS', 'EDGES', 'HIST')  # Records of the summary (dual-rate) output modes
 
 # ===== Qt signal bridge =====
 class Communication(QObject):
-    spec_data_ready = Signal(int, np.ndarray)
+    spec_data_ready = Signal(int, np.ndarray, dict)
+    tile_ready = Signal(int, np.ndarray, np.ndarray)
+    summary_ready = Signal(str, int, int, int, int, list)
 
 # ---------- Parser ----------
 def parse_spectrum_frame(line: str):
@@ -29,28 +33,128 @@ def parse_spectrum_frame(line: str):
         payload = line[len(BEGIN_TOKEN):-len(END_TOKEN)].rstrip(',')
         if not payload: return None
         parts = payload.split(',')
-        sensor_id = int(parts[0].split('_')[1])
-        data_string = ','.join(parts[1:])
-        arr = np.fromstring(data_string, sep=',', dtype=np.uint16)
+        # Header tokens look like KEY_value (SENSOR_0, WLSTART_400.0000, ...) and precede the pixel data
+        header = {}
+        n_header = 0
+        while n_header < len(parts) and '_' in parts[n_header]:
+            key, value = parts[n_header].split('_', 1)
+            header[key] = value
+            n_header += 1
+        sensor_id = int(header['SENSOR'])
+        if header.get('RES') == '8' and len(parts) == n_header + 1:
+            # 8-bit frames are sent as two hex digits per pixel
+            arr = np.frombuffer(bytes.fromhex(parts[n_header]), dtype=np.uint8).astype(np.uint16)
+        else:
+            data_string = ','.join(parts[n_header:])
+            arr = np.fromstring(data_string, sep=',', dtype=np.uint16)
         if arr.size != NUM_PIXELS:
             return None
-        return sensor_id, arr
+        return sensor_id, arr, header
+    except (ValueError, IndexError, KeyError):
+        return None
+
+def decode_med(residuals: np.ndarray) -> np.ndarray:
+    """Inverts the device's median edge detector prediction (left a, up b, up-left c; missing neighbours are 0)."""
+    lines, width = residuals.shape
+    image = np.zeros((lines, width), dtype=np.int32)
+    prev = [0] * width
+    for y in range(lines):
+        res = residuals[y].tolist()
+        row = [0] * width
+        a = c = 0
+        for x in range(width):
+            b = prev[x]
+            lo, hi = (a, b) if a < b else (b, a)
+            if c >= hi:
+                pred = lo
+            elif c <= lo:
+                pred = hi
+            else:
+                pred = a + b - c
+            a = pred + res[x]
+            row[x] = a
+            c = b
+        image[y] = row
+        prev = row
+    return image
+
+def parse_summary_record(line: str):
+    """Parses "TAG,SENSOR_[ID],{seq},{timestamp_us},{dropped},{fields...},END" into
+    (tag, sensor_id, seq, timestamp_us, dropped, fields). seq, timestamp_us and dropped match the SEQ_, TS_ and
+    DROP_ tokens of the full frames sent in dual-rate mode; dropped is the sensor's running count of lost frames."""
+    parts = line.strip().rstrip(',').split(',')
+    if len(parts) < 6 or parts[0] not in SUMMARY_TAGS or parts[-1] != END_TOKEN:
+        return None
+    try:
+        sensor_id = int(parts[1].split('_', 1)[1])
+        return parts[0], sensor_id, int(parts[2]), int(parts[3]), int(parts[4]), parts[5:-1]
     except (ValueError, IndexError):
         return None
 
+class TileAssembler:
+    """Collects TILE_BEGIN / TILE_LINE / TILE_END records into one line-scan image."""
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.sensor_id = None
+        self.lines = []
+        self.timestamps = []
+
+    def feed(self, line: str):
+        """Returns (sensor_id, image, timestamps) when a tile is complete, else None."""
+        parts = line.strip().rstrip(',').split(',')
+        if not parts or parts[-1] != END_TOKEN:
+            return None
+        try:
+            if parts[0] == 'TILE_BEGIN':
+                self.reset()
+                self.sensor_id = int(parts[1].split('_', 1)[1])
+                self.num_lines, self.width, self.coding = int(parts[3]), int(parts[4]), parts[5]
+            elif parts[0] == 'TILE_LINE' and self.sensor_id is not None:
+                values = np.array(parts[4:-1], dtype=np.int32)
+                if values.size != self.width:
+                    self.reset()   # Truncated line: drop the tile
+                    return None
+                self.timestamps.append(int(parts[3]))
+                self.lines.append(values)
+            elif parts[0] == 'TILE_END' and self.sensor_id is not None:
+                if len(self.lines) != self.num_lines:
+                    self.reset()
+                    return None
+                image = np.vstack(self.lines)
+                if self.coding == 'MED':
+                    image = decode_med(image)
+                result = (self.sensor_id, image.astype(np.uint16), np.array(self.timestamps, dtype=np.uint32))
+                self.reset()
+                return result
+        except (ValueError, IndexError):
+            self.reset()
+        return None
+
 # ---------- Serial reader ----------
 def serial_reader_thread(ser: serial.Serial, comm: Communication, stop_event: threading.Event):
     print("Serial reader thread started...")
+    tiles = TileAssembler()
     while not stop_event.is_set():
         if not ser or not ser.is_open: break
         try:
             line_bytes = ser.readline()
             if not line_bytes: continue
             line = line_bytes.decode(SERIAL_ENCODING, errors='ignore')
+            if line.startswith('TILE_'):
+                tile = tiles.feed(line)
+                if tile:
+                    comm.tile_ready.emit(*tile)
+                continue
+            summary = parse_summary_record(line)
+            if summary:
+                comm.summary_ready.emit(*summary)
+                continue
             parse_result = parse_spectrum_frame(line)
             if parse_result:
-                sensor_id, spectrum_data = parse_result
-                comm.spec_data_ready.emit(sensor_id, spectrum_data)
+                sensor_id, spectrum_data, header = parse_result
+                comm.spec_data_ready.emit(sensor_id, spectrum_data, header)
         except Exception:
             break
     print("Serial reader thread exited.")
@@ -91,6 +195,29 @@ def generate_spectral_brushes():
         brushes.append(pg.mkBrush(color=final_rgb))
     return brushes
 
+# ---------- Line-scan image window ----------
+class LineScanWindow(QWidget):
+    """Scrolling 2D view of the tiles of a line-scan sensor (newest lines at the bottom)."""
+    def __init__(self):
+        super().__init__()
+        self.setWindowTitle('S10077 Line Scan')
+        self.setGeometry(150, 150, 1000, 600)
+        layout = QVBoxLayout(self)
+        self.info_label = QLabel("Waiting for tiles")
+        self.image_view = pg.ImageView()
+        layout.addWidget(self.info_label)
+        layout.addWidget(self.image_view)
+        self.history = {}
+
+    def add_tile(self, sensor_id: int, image: np.ndarray, timestamps: np.ndarray):
+        lines = np.vstack([self.history.get(sensor_id, np.zeros((0, image.shape[1]), np.uint16)), image])
+        self.history[sensor_id] = lines[-TILE_HISTORY_LINES:]
+        # ImageView expects (x, y): pixels along x, lines along y
+        self.image_view.setImage(self.history[sensor_id].T, autoLevels=False, levels=(0, int(image.max()) or 1))
+        if timestamps.size > 1:
+            line_rate = (timestamps.size - 1) * 1e6 / max(int(timestamps[-1]) - int(timestamps[0]), 1)
+            self.info_label.setText(f"Sensor {sensor_id}: {image.shape[0]} lines/tile, {line_rate:.1f} lines/s")
+
 # ---------- Main window ----------
 class MainWindow(QMainWindow):
     def __init__(self):
@@ -106,6 +233,7 @@ class MainWindow(QMainWindow):
         self.plot_widgets = {}
         self.bar_items = {}
         self.spectral_brushes = generate_spectral_brushes()
+        self.line_scan_window = None
 
         # --- 新增模式控制 ---
         self.spec_mode = False  # 默认单色
@@ -228,14 +356,39 @@ class MainWindow(QMainWindow):
                 sensor_id += 1
 
 
-    def update_plot(self, sensor_id: int, data_array: np.ndarray):
+    def update_plot(self, sensor_id: int, data_array: np.ndarray, header: dict):
         if sensor_id in self.bar_items:
-            self.bar_items[sensor_id].setOpts(height=data_array)
+            # HDR frames are in long-exposure counts and extend beyond the ADC range
+            y_max = ((1 << int(header.get('RES', 12))) - 1) * float(header.get('HDR', 1))
+            plot_widget = self.plot_widgets[sensor_id]
+            if plot_widget.getViewBox().state['limits']['yLimits'][1] != y_max:
+                plot_widget.getViewBox().setLimits(yMin=0, yMax=y_max)
+                plot_widget.setYRange(0, y_max)
+            if self.spec_mode and 'WLSTART' in header and 'WLEND' in header:
+                # Frame was resampled on the device onto a uniform wavelength grid
+                wavelengths = np.linspace(float(header['WLSTART']), float(header['WLEND']), NUM_PIXELS)
+                self.bar_items[sensor_id].setOpts(x=wavelengths, height=data_array,
+                                                  width=(wavelengths[1]-wavelengths[0])*0.9)
+            else:
+                self.bar_items[sensor_id].setOpts(height=data_array)
+
+    def update_summary(self, tag: str, sensor_id: int, seq: int, timestamp_us: int, dropped: int, fields: list):
+        # Summaries share seq/timestamp with the full frames that dual-rate mode interleaves
+        self.status_label.setText(f"Sensor {sensor_id} {tag} #{seq} at {timestamp_us / 1e6:.3f} s "
+                                  f"({dropped} dropped): {','.join(fields[:8])}")
+
+    def update_tile(self, sensor_id: int, image: np.ndarray, timestamps: np.ndarray):
+        if self.line_scan_window is None:
+            self.line_scan_window = LineScanWindow()
+        self.line_scan_window.show()
+        self.line_scan_window.add_tile(sensor_id, image, timestamps)
 
     def connect_signals(self):
         self.refresh_btn.clicked.connect(self.refresh_ports)
         self.connect_btn.clicked.connect(self.toggle_connection)
         self.comm.spec_data_ready.connect(self.update_plot)
+        self.comm.tile_ready.connect(self.update_tile)
+        self.comm.summary_ready.connect(self.update_summary)
         self.layout_combo.currentTextChanged.connect(self.setup_plot_layout)
         self.mode_combo.currentTextChanged.connect(self.switch_mode)
         self.focus_combo.currentTextChanged.connect(lambda _: self.setup_plot_layout(self.layout_combo.currentText()))
@@ -285,6 +438,8 @@ class MainWindow(QMainWindow):
             self.serial_thread.join(timeout=1.0)
         if self.ser and self.ser.is_open:
             self.ser.close()
+        if self.line_scan_window:
+            self.line_scan_window.close()
         event.accept()
 
 # ---------- Entrypoint ----------